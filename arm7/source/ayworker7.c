@@ -0,0 +1,55 @@
+// =====================================================================================
+// The ARM7 end of the WAVE DIRECT sound worker (see arm9/source/cpu/ay38910/AYWorker.h).
+// The ARM9 hands us the worker over the FIFO and kicks us once a frame - we play its
+// queue of AY writes into our copy of the chip and render into its ring in main RAM.
+// When the ARM9 wants it back it sets the worker's revoked flag (and kicks us) - we
+// look at that before every pump and once we see it we let go and set released.
+//
+// The chip and the worker are built from the very same sources as on the ARM9 - the
+// portable C version of the chip as the ARM7 can't run the ARMv5 assembly. AY_UPSHIFT
+// comes from the top Makefile for both CPUs so the two copies of the chip agree.
+// =====================================================================================
+#include <nds.h>
+
+#define AY_PORTABLE_C
+
+#ifndef AY_UPSHIFT
+#error AY_UPSHIFT must be passed in by the Makefile
+#endif
+
+#include "../../arm9/source/cpu/ay38910/AY38910C.c"
+#include "../../arm9/source/cpu/ay38910/AYWorker.c"
+
+static AYWorker *volatile worker = 0;
+
+static void ayWorkerAddressHandler(void *address, void *userdata)
+{
+    worker = (AYWorker *)address;
+}
+
+// A kick only has to wake up the main loop - which the FIFO interrupt already did
+static void ayWorkerValueHandler(u32 value, void *userdata)
+{
+}
+
+void ayWorkerInstall(void)
+{
+    fifoSetAddressHandler(AYWORKER_FIFO, ayWorkerAddressHandler, 0);
+    fifoSetValue32Handler(AYWORKER_FIFO, ayWorkerValueHandler, 0);
+}
+
+// Each time the main loop wakes up - play out whatever is queued unless the ARM9 wants it back
+void ayWorkerRun(void)
+{
+    AYWorker *w = worker;
+    if (!w) return;
+
+    if (w->revoked)
+    {
+        worker = 0;
+        w->released = 1;    // The ARM9 can have it back - we won't touch it again
+        return;
+    }
+
+    ayWorkerPump(w);
+}
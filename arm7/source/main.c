@@ -32,6 +32,8 @@
 #include <maxmod7.h>
 
 extern void mmInstall( int fifo_channel );
+extern void ayWorkerInstall(void);
+extern void ayWorkerRun(void);
 
 //---------------------------------------------------------------------------------
 void VblankHandler(void) {
@@ -76,6 +78,8 @@ int main() {
 
 	installSystemFIFO();
 
+	ayWorkerInstall();
+
 	irqSet(IRQ_VCOUNT, VcountHandler);
 	irqSet(IRQ_VBLANK, VblankHandler);
 
@@ -83,13 +87,15 @@ int main() {
 	
 	setPowerButtonCB(powerButtonCB);   
 
-	// Keep the ARM7 mostly idle
+	// Keep the ARM7 mostly idle - other than the WAVE DIRECT sound worker when the ARM9 hands it to us
 	while (!exitflag) {
 		if ( 0 == (REG_KEYINPUT & (KEY_SELECT | KEY_START | KEY_L | KEY_R))) {
 			exitflag = true;
 		}
-    
-		swiWaitForVBlank();
+
+		ayWorkerRun();
+
+		swiIntrWait(0, IRQ_VBLANK | IRQ_FIFO_NOT_EMPTY);
 	}
 	return 0;
 }
@@ -28,6 +28,7 @@
 #include "printf.h"
 
 #include "CRC32.h"
+#include "arena.h"
 #include "printf.h"
 
 int         countFiles=0;
@@ -73,6 +74,7 @@ u32 file_crc __attribute__((section(".dtcm")))  = 0x00000000;  // Our global fil
 // The AY sound chip is used for the Amstrad CPC machines
 // -----------------------------------------------------------
 AY38910 myAY   __attribute__((section(".dtcm")));
+AYBlip  myBlip;                                 // Band-limited output state (the BLEP sound synth)
 
 u16 JoyState   __attribute__((section(".dtcm"))) = 0;           // Joystick State and Key Bits
 
@@ -887,6 +889,9 @@ void SetDefaultGlobalConfig(void)
     myGlobalConfig.lastDir        = 0;    // Default is to start in /roms/cpc
     myGlobalConfig.debugger       = 0;    // Debugger is not shown by default
     myGlobalConfig.splashType     = 0;    // Show the Amstrad Croc by default
+    myGlobalConfig.lineBuffer     = 0;    // Draw straight into VRAM by default
+    myGlobalConfig.ayBlip         = 0;    // Point sampled AY sound by default
+    myGlobalConfig.soundWorker    = 0;    // WAVE DIRECT sound is rendered on the ARM9 by default
 }
 
 void SetDefaultGameConfig(void)
@@ -913,8 +918,8 @@ void SetDefaultGameConfig(void)
     myConfig.diskWrite   = 1;                           // Default is to allow write back to SD
     myConfig.crtcDriver  = CRTC_DRV_STANDARD;           // Default is standard driver
     myConfig.reserved0   = 0;
-    myConfig.reserved1   = 0;
-    myConfig.reserved2   = 0;
+    myConfig.frameSkip   = 0;                           // Default is to draw every frame
+    myConfig.skipTarget  = 0;                           // And if frame skip is on, skip below 50 FPS
     myConfig.reserved3   = 0;
 }
 
@@ -1048,6 +1053,8 @@ const struct options_t Option_Table[2][20] =
         {"SOUND DRV",      {"NORMAL", "WAVE DIRECT"},                                           &myConfig.waveDirect,        2},
         {"DISK WRITE",     {"OFF", "ALLOWED"},                                                  &myConfig.diskWrite,         2},
         {"CRTC DRIVER",    {"STANDARD", "ADVANCED"},                                            &myConfig.crtcDriver,        2},
+        {"FRAME SKIP",     {"OFF", "AUTO 1 MAX", "AUTO 2 MAX", "AUTO 3 MAX"},                   &myConfig.frameSkip,         4},
+        {"SKIP BELOW",     {"50 FPS", "45 FPS", "40 FPS"},                                      &myConfig.skipTarget,        3},
 
         {NULL,             {"",      ""},                                                       NULL,                        1},
     },
@@ -1059,6 +1066,9 @@ const struct options_t Option_Table[2][20] =
         {"SPLASH SCR",     {"AMSTRAD CROC", "CPC KEYBOARD"},                                    &myGlobalConfig.splashType,  2},
         {"KEYBD BRIGHT",   {"MAX BRIGHT", "DIM", "DIMMER", "DIMMEST"},                          &myGlobalConfig.keyboardDim, 4},
 
+        {"RENDER",         {"DIRECT VRAM", "LINE BUFFER"},                                      &myGlobalConfig.lineBuffer,  2},
+        {"SOUND SYNTH",    {"POINT 31KHZ", "BLEP 22KHZ"},                                       &myGlobalConfig.ayBlip,      2},
+        {"SOUND WORKER",   {"ARM9", "ARM7"},                                                    &myGlobalConfig.soundWorker, 2},
         {"DEBUGGER",       {"OFF", "BAD OPS", "DEBUG", "FULL DEBUG"},                           &myGlobalConfig.debugger,    4},
         {NULL,             {"",      ""},                                                       NULL,                        1},
     }
@@ -1434,7 +1444,7 @@ void ReadFileCRCAndConfig(void)
     // ----------------------------------------------------------------------------------
     // Clear the entire ROM buffer[] - fill with 0xFF to emulate non-responsive memory
     // ----------------------------------------------------------------------------------
-    memset(ROM_Memory, 0xFF, MAX_ROM_SIZE);
+    memset(ROM_Memory, 0xFF, sizeof(ROM_Memory));
 
     if (strstr(gpFic[ucGameChoice].szName, ".dsk") != 0) amstrad_mode = MODE_DSK;
     if (strstr(gpFic[ucGameChoice].szName, ".DSK") != 0) amstrad_mode = MODE_DSK;
@@ -2007,6 +2017,7 @@ u8 loadgame(const char *filename)
     fclose(handle); // We only need to close the file - the game ROM is now sitting in ROM_Memory[] from the getFileCrc() handler
 
     last_file_size = (u32)romSize;
+    arena_use(ARENA_ROM, last_file_size);
   }
 
   return bOK;
@@ -14,10 +14,13 @@
 #include "SugarDS.h"
 #include "cpu/z80/Z80_interface.h"
 #include "cpu/ay38910/AY38910.h"
+#include "cpu/ay38910/AYBlip.h"
+#include "cpu/ay38910/AYWorker.h"
 
 #define MAX_FILES                   1024
 #define MAX_FILENAME_LEN            160
 #define MAX_ROM_SIZE               (1024*1024) // 1024K is big enough for any disk / cart / snapshot
+#define DSK_HEADER_SIZE            0x100       // The .dsk header - ROM_Memory[] has room for it on top
 
 #define MAX_CONFIGS                 890
 #define CONFIG_VERSION              0x0009
@@ -69,9 +72,9 @@ struct __attribute__((__packed__)) GlobalConfig_t
     u8  diskROM;
     u8  splashType;
     u8  keyboardDim;
-    u8  global_04;
-    u8  global_05;
-    u8  global_06;
+    u8  lineBuffer;
+    u8  ayBlip;
+    u8  soundWorker;
     u8  global_07;
     u8  global_08;
     u8  global_09;
@@ -99,8 +102,8 @@ struct __attribute__((__packed__)) Config_t
     u8  panAndScan;
     u8  diskWrite;
     u8  crtcDriver;
-    u8  reserved1;
-    u8  reserved2;
+    u8  frameSkip;
+    u8  skipTarget;
     u8  reserved3;
     s8  offsetX;
     s8  offsetY;
@@ -127,12 +130,15 @@ extern u8 BufferedKeysReadIdx;
 extern u8 portA, portB, portC, portDIR;
 extern u8 RAM_512k_bank;
 
-extern u8 ROM_Memory[MAX_ROM_SIZE];
+extern u8 ROM_Memory[MAX_ROM_SIZE + DSK_HEADER_SIZE];
 extern u8 RAM_Memory[0x20000]; // 64K plus an expanded 512K
 
 extern u8 *MemoryMapR[4];
 extern u8 *MemoryMapW[4];
 extern AY38910 myAY;
+extern AYBlip  myBlip;
+extern AYWorker *ayWorker;   // The WAVE DIRECT sound worker (see SugarDS.c)
+extern u8 ay_worker_held;    // The ARM7 still has it after we gave up on it (see SugarDS.c)
 
 extern FIAmstrad gpFic[MAX_FILES];
 extern int uNbRoms;
@@ -157,6 +163,9 @@ extern void amstrad_emulate(void);
 extern u8   cpu_readport_ams(register unsigned short Port);
 extern void amstrad_reset(void);
 extern u32  amstrad_run(void);
+#ifdef Z80_PROFILE
+extern void profile_save(void);
+#endif
 extern void getfile_crc(const char *path);
 extern void amstradLoadState();
 extern void amstradSaveState();
@@ -35,6 +35,7 @@
 #include "fdc.h"
 #include "amsdos.h"
 #include "printf.h"
+#include "arena.h"
 
 // -----------------------------------------------------------------
 // Most handy for development of the emulator is a set of 16 R/W
@@ -51,7 +52,7 @@ u8 floppy_sound=0;
 u8 floppy_action=0;
 
 u8 RAM_Memory[0x20000]      ALIGN(32) = {0};  // The Z80 Memory is 64K but the Amstrad CPC 6128 is 128K so we reserve the full amount
-u8 ROM_Memory[MAX_ROM_SIZE] ALIGN(32) = {0};  // This is where we keep the raw untouched file as read from the SD card (.DSK, .SNA)
+u8 ROM_Memory[MAX_ROM_SIZE + DSK_HEADER_SIZE] ALIGN(32) = {0};  // This is where we keep the raw untouched file as read from the SD card (.DSK, .SNA)
 
 s16 temp_offset   __attribute__((section(".dtcm"))) = 0;
 s16 perm_offset   __attribute__((section(".dtcm"))) = 0;
@@ -92,6 +93,12 @@ u16 emuFps          __attribute__((section(".dtcm"))) = 0;
 u16 emuActFrames    __attribute__((section(".dtcm"))) = 0;
 u16 timingFrames    __attribute__((section(".dtcm"))) = 0;
 u32 emuTotFrames    __attribute__((section(".dtcm"))) = 0;
+u16 emuShownFrames  = 0;    // Frames actually drawn in the last second (auto frame skip)
+u16 frameStartTicks = 0;    // TIMER2 when the emulation of this frame began
+u8  framesSkipped   = 0;    // How many frames in a row have not been drawn
+u32 ink_updates_sec = 0;    // Pre-inked table updates in the last second (for the debugger)
+u32 ink_entries_sec = 0;    // And how many table entries they rebuilt
+u32 render_us_frame = 0;    // Microseconds a frame spent drawing lines (for the debugger)
 
 // Set to 1 to pause (mute) sound, 0 is sound unmuted (sound channels active)
 u8 soundEmuPause    __attribute__((section(".dtcm"))) = 1;
@@ -260,18 +267,18 @@ void SoundUnPause(void)
 // --------------------------------------------------------------------------------------------
 #define sample_rate         (30800)    // To roughly match how many samples (4x per scanline x 312 scanlines x 50 frames)
 #define buffer_size         (512+16)   // Enough buffer that we don't have to fill it too often. Must be multiple of 16.
+#define blip_rate           (22050)    // The band-limited AY output needs no more than this (see AYBlip.c)
+#define ay_tick_rate        (125000)   // The CPC's AY runs at 1MHz and its tone counters at 1/8 of that
 
 mm_ds_system sys   __attribute__((section(".dtcm")));
 mm_stream myStream __attribute__((section(".dtcm")));
 
-#define WAVE_DIRECT_BUF_SIZE 4095
-u16 mixer_read      __attribute__((section(".dtcm"))) = 0;
-u16 mixer_write     __attribute__((section(".dtcm"))) = 0;
-s16 mixer[WAVE_DIRECT_BUF_SIZE+1];
+u8  rs_speed = 0xFF;                    // The game speed the worker's resampling ratio was worked out for
 
 
 // The games normally run at the proper 100% speed, but user can override from 80% to 130%
 u16 GAME_SPEED_PAL[]  __attribute__((section(".dtcm"))) = {653, 595, 546, 500, 728, 818 };
+u8  SKIP_TARGET_FPS[] = {50, 45, 40};  // Frame rate below which the auto frame skip kicks in
 
 // -------------------------------------------------------------------------------------------
 // maxmod will call this routine when the buffer is half-empty and requests that
@@ -279,7 +286,8 @@ u16 GAME_SPEED_PAL[]  __attribute__((section(".dtcm"))) = {653, 595, 546, 500, 7
 // we will fill exactly that many. If the sound is paused, we fill with 'mute' samples.
 // -------------------------------------------------------------------------------------------
 s16 last_sample __attribute__((section(".dtcm"))) = 0;
-int breather    __attribute__((section(".dtcm"))) = 0;
+u8  blip_active = 0;    // The stream was opened at blip_rate for the band-limited AY output
+s16 mixbufAY[4] __attribute__((section(".dtcm")));
 
 ITCM_CODE mm_word OurSoundMixer(mm_word len, mm_addr dest, mm_stream_formats format)
 {
@@ -296,63 +304,244 @@ ITCM_CODE mm_word OurSoundMixer(mm_word len, mm_addr dest, mm_stream_formats for
     {
         if (myConfig.waveDirect)
         {
-            s16 *p = (s16*)dest;
-            for (int i=0; i<len*2; i++)
+            if (ay_worker_held)                                         // The ARM7 hasn't let go of the worker...
             {
-                if (mixer_read == mixer_write) {processDirectAudio();}
-                else
-                {
-                    last_sample = mixer[mixer_read];
-                    *p++ = last_sample;
-                    mixer_read = (mixer_read + 1) & WAVE_DIRECT_BUF_SIZE;
-                }
+                s16 *p = (s16*)dest;
+                for (int i=0; i<len*2; i++) *p++ = last_sample;         // ...so we stay off it and hold the sound
             }
-            if (breather) {breather -= (len*2); if (breather < 0) breather = 0;}
+            else ayWorkerPlay(ayWorker, len*2, (s16*)dest);             // Whatever the sound worker has rendered
+        }
+        else if (blip_active)
+        {
+            s16 *p = (s16*)dest;
+            ayBlipMixer(len, p, &myAY, &myBlip);                        // One mono sample per stereo pair...
+            for (int i=len-1; i>=0; i--) p[2*i] = p[2*i+1] = p[i];      // ...and out to both sides
         }
         else
         {
             ay38910Mixer(2*len, dest, &myAY);
-            last_sample = ((s16*)dest)[len*2 - 1];
         }
+        last_sample = ((s16*)dest)[len*2 - 1];
     }
 
     return len;
 }
 
 // --------------------------------------------------------------------------------------------
-// This is called when we want to sample the audio directly - we grab 4x AY samples that
-// will be played back by the mixer routine directly above...
+// WAVE DIRECT sound. Rather than sampling the AY once per scanline, the AY data writes are
+// queued along with the T-state the CPU made them at (see ay_log_write) for the sound worker
+// (cpu/ay38910/AYWorker.c). It plays each write into its own copy of the AY right at its own
+// sample position (4 samples per scanline) so digitized speech and sample playback come out
+// at the correct pitch and timing and renders into the ring that OurSoundMixer() plays from.
+// The emulation only ever queues - the worker runs on the ARM9 as each frame is queued or
+// on the otherwise idle ARM7 (picked in the global options).
 // --------------------------------------------------------------------------------------------
-s16 mixbufAY[4]  __attribute__((section(".dtcm")));
-ITCM_CODE void processDirectAudio(void)
+#define AY_TSTATES_PER_SAMPLE   (LINE_TSTATES/4)
+
+AYWorker myWorker __attribute__((aligned(32)));                     // In main RAM so the ARM7 can share it
+AYWorker *ayWorker __attribute__((section(".dtcm"))) = &myWorker;   // Through the uncached mirror when shared
+u8 ay_worker_live = 0;      // The worker has its copy of the chip and is following the CPU time
+u8 ay_worker_arm7 = 0xFF;   // Which worker backend is running (0xFF until the first is started)
+
+// ----------------------------------------------------------------------------------------
+// The ARM7 worker (see arm7/source/ayworker7.c). We hand it the worker over the FIFO and
+// kick it at each frame - it wakes on the FIFO, plays out the queue and goes back to sleep.
+// To get the worker back we set its revoked flag and the ARM7 sets released once it has
+// let go. Playing out a frame takes it well under a scanline or two so if it hasn't
+// answered after a few frames' worth of scanlines we stop waiting - but it may still be
+// in the middle of a pump (or just slow) so the worker stays the ARM7's and the WAVE
+// DIRECT sound is held silent until it does let go. Then the worker is set up afresh and
+// run in line from then on (until the next power up).
+// ----------------------------------------------------------------------------------------
+#define ARM7_WORKER_PATIENCE    (4*263)     // Scanlines we wait on the ARM7 before giving up on it
+
+u8 ay_worker_arm7_lost = 0;                 // The ARM7 stopped answering - no going back to it
+u8 ay_worker_held = 0;                      // And it still has the worker - hands off until it lets go
+
+static u8 arm7_worker_timeout(u16 *line, u16 *lines)
+{
+    u16 vcount = REG_VCOUNT;
+    if (vcount != *line)
+    {
+        *line = vcount;
+        if (++*lines >= ARM7_WORKER_PATIENCE) return 1;
+    }
+    return 0;
+}
+
+static void arm7_worker_lost(AYWorker *worker)
+{
+    worker->revoked = 1;    // The ARM7 lets go before its next pump - whenever that is
+    ay_worker_arm7_lost = 1;
+    ay_worker_held = 1;
+    ay_worker_live = 0;     // Nothing more is queued for it
+}
+
+static void arm7_worker_start(AYWorker *worker)
+{
+    fifoSendAddress(AYWORKER_FIFO, &myWorker);
+}
+
+static void arm7_worker_kick(AYWorker *worker)
+{
+    fifoSendValue32(AYWORKER_FIFO, AYWORKER_FIFO_KICK);
+}
+
+static void arm7_worker_wait(AYWorker *worker)
 {
-    ay38910Mixer(4, mixbufAY, &myAY);
+    u16 line = REG_VCOUNT, lines = 0;
 
-    for (u8 i=0; i<4; i++)
+    arm7_worker_kick(worker);
+    while (worker->tail != worker->head)
     {
-        if (breather) {return;}
-        mixer[mixer_write] = mixbufAY[i];
-        mixer_write++; mixer_write &= WAVE_DIRECT_BUF_SIZE;
-        if (((mixer_write+1)&WAVE_DIRECT_BUF_SIZE) == mixer_read) {breather = 2048;}
+        if (arm7_worker_timeout(&line, &lines)) {arm7_worker_lost(worker); return;}
     }
 }
 
+static void arm7_worker_stop(AYWorker *worker)
+{
+    u16 line = REG_VCOUNT, lines = 0;
+
+    worker->revoked = 1;
+    arm7_worker_kick(worker);   // Wake it up to see that
+    while (!worker->released)
+    {
+        if (arm7_worker_timeout(&line, &lines)) {arm7_worker_lost(worker); return;}
+    }
+}
+
+static const AYWorkerBackend ayWorkerARM7 = {"ARM7", arm7_worker_start, arm7_worker_stop, arm7_worker_kick, arm7_worker_wait};
+
+// ----------------------------------------------------------------------------------------
+// Start the worker on whichever CPU the global options ask for. When the ARM7 has it we
+// go through the uncached mirror of main RAM so both CPUs always see the same worker.
+// ----------------------------------------------------------------------------------------
+static void ay_worker_select(void)
+{
+    u8 arm7 = myGlobalConfig.soundWorker && !ay_worker_arm7_lost;
+    if (arm7 == ay_worker_arm7) return;
+
+    if (ay_worker_held)
+    {
+        if (!ayWorker->released) return;    // The ARM7 still has it - we can't touch it yet
+        ay_worker_held = 0;                 // It finally let go - set it up to run in line
+    }
+
+    u8 paused = soundEmuPause;
+    soundEmuPause = 1;      // Keep OurSoundMixer() off the worker while it changes hands
+
+    if (ay_worker_arm7 != 0xFF) ayWorkerStop(ayWorker);
+
+    if (ay_worker_held)     // No answer from the ARM7 - it keeps the worker for now
+    {
+        soundEmuPause = paused;
+        return;
+    }
+
+    int oldIME = enterCriticalSection();
+    DC_FlushRange(&myWorker, sizeof(myWorker));
+    DC_InvalidateRange(&myWorker, sizeof(myWorker));
+    leaveCriticalSection(oldIME);
+
+    ayWorker = arm7 ? (AYWorker *)memUncached(&myWorker) : &myWorker;
+    ayWorkerInit(ayWorker, arm7 ? &ayWorkerARM7 : &ayWorkerInline, AY_TSTATES_PER_SAMPLE);
+
+    ay_worker_arm7 = arm7;
+    ay_worker_live = 0;
+    rs_speed = 0xFF;
+    soundEmuPause = paused;
+}
+
+// --------------------------------------------------------------------------
+// An AY data write from the CPU (already made to myAY) - queue it for the
+// worker along with the time it was made at.
+// --------------------------------------------------------------------------
+ITCM_CODE void ay_log_write(u8 value)
+{
+    if (ay_worker_live) ayWorkerPush(ayWorker, CPU.TStates, myAY.ayRegIndex, value);
+}
+
+// ---------------------------------------------------------------------------------------
+// Once a frame at the VSYNC - have the worker render up to here. The first frame after
+// WAVE DIRECT comes on (or after a reset) hands the worker the chip as it is right now.
+// The resampling ratio follows the game speed - the DS frame timer against the stream
+// rate - and the worker trims it to keep its ring around half full.
+// ---------------------------------------------------------------------------------------
+void ay_log_frame(u32 tstates)
+{
+    if (!myConfig.waveDirect)
+    {
+        ay_worker_live = 0;
+        return;
+    }
+
+    ay_worker_select();     // In case it was moved to the other CPU in the global options
+    if (ay_worker_held) return;
+
+    if (!ay_worker_live)
+    {
+        ayWorkerSync(ayWorker, &myAY, tstates);
+        if (ay_worker_held) return;     // The ARM7 never played out its queue - it keeps the worker
+        ay_worker_live = 1;
+    }
+
+    if (rs_speed != myConfig.gameSpeed)
+    {
+        rs_speed = myConfig.gameSpeed;
+        // Rendered: 4 x 312 samples per frame at BUS_CLOCK/1024/GAME_SPEED_PAL frames per second
+        ayWorker->baseStep = (u32)(((u64)(4*312) * BUS_CLOCK * 0x10000) / ((u64)1024 * GAME_SPEED_PAL[rs_speed] * myStream.sampling_rate * 2));
+    }
+
+    ayWorkerPush(ayWorker, tstates, AYW_FRAME, 0);
+    ayWorkerKick(ayWorker);
+}
+
+// The CPU time is rebased every 16 frames - the worker's clock follows when it gets there
+void ay_log_rebase(u32 tstates)
+{
+    if (ay_worker_live) ayWorkerPush(ayWorker, tstates, AYW_REBASE, 0);
+}
+
+// The chip or the CPU time were changed under the worker (reset, load state) - it takes a fresh copy at the frame end
+void ay_log_reset(void)
+{
+    ay_worker_live = 0;
+}
+
 // -----------------------------------------------------------------------------------------------
 // The user can override the core emulation speed from 80% to 130% to make games play faster/slow
 // than normal. We must adjust the MaxMode sample frequency to match or else we will not have the
 // proper number of samples in our sound buffer... this isn't perfect but it's reasonably good!
+// WAVE DIRECT doesn't need this - its resampler follows the game speed (see ay_log_frame).
+// The band-limited (BLEP) AY output runs the stream at blip_rate rather than sample_rate.
 // -----------------------------------------------------------------------------------------------
 static u8 last_game_speed = 0;
+static u8 last_wave_direct = 0;
+static u8 last_blip = 0;
 static u32 sample_rate_adjust[] = {100, 110, 120, 130, 90, 80};
 void newStreamSampleRate(void)
 {
-    if (last_game_speed != myConfig.gameSpeed)
+    u8 speed = myConfig.waveDirect ? 0 : myConfig.gameSpeed;
+    u8 blip  = myConfig.waveDirect ? 0 : myGlobalConfig.ayBlip;
+
+    ay_worker_select();
+    ay_log_reset();
+    rs_speed = 0xFF;    // Have ay_log_frame() work out the resampling ratio afresh
+
+    if ((last_game_speed != speed) || (last_wave_direct != myConfig.waveDirect) || (last_blip != blip))
     {
-        last_game_speed = myConfig.gameSpeed;
+        last_game_speed = speed;
+        last_wave_direct = myConfig.waveDirect;
+        last_blip = blip;
+        blip_active = 0;
         mmStreamClose();
 
+        // The band-limited output is set up for the plain rate - the speed adjust then shifts its pitch just the same
+        if (blip) ayBlipInit(&myBlip, ay_tick_rate, blip_rate);
+        blip_active = blip;
+
         // Adjust the sample rate to match the core emulation speed... user can override from 80% to 130%
-        int new_sample_rate     = (sample_rate * sample_rate_adjust[myConfig.gameSpeed]) / 100;
+        int new_sample_rate     = ((blip ? blip_rate : sample_rate) * sample_rate_adjust[speed]) / 100;
         myStream.sampling_rate  = new_sample_rate;        // sample_rate for the CPC to match the AY/Beeper drivers
         myStream.buffer_length  = buffer_size;            // buffer length = (512+16)
         myStream.callback       = OurSoundMixer;          // set callback function
@@ -521,7 +710,33 @@ void ShowDebugZ80(void)
 
         idx++;
 
-        if (debug_area == 1)
+        if (debug_area == 2)
+        {
+            // The memory budget - size and peak use of each arena region plus the heap
+            for (u8 i=0; i<=ARENA_REGIONS+1; i++)
+            {
+                arena_report_line(i, tmp); DSPrint(0,idx++,7, tmp);
+            }
+
+            // And how long a frame spends drawing lines - straight to VRAM or via the line buffers
+            sprintf(tmp, "%-4s %6luUS/F", myGlobalConfig.lineBuffer ? "LBUF" : "VRAM", render_us_frame);
+            DSPrint(0,idx++,7, tmp);
+
+            // The WAVE DIRECT ring - fill and rate trim (PPM) then the underrun and overrun counts and where the worker runs
+            if (ay_worker_held)
+            {
+                DSPrint(0,idx++,7, "RING HELD - ARM7");
+                DSPrint(0,idx++,7, "SOUND MUTED     ");
+            }
+            else
+            {
+                sprintf(tmp, "RING %4ld %+6ld", ayWorker->fill, ayWorker->trim);
+                DSPrint(0,idx++,7, tmp);
+                sprintf(tmp, "U%-5lu O%-5lu %s", ayWorker->underruns, ayWorker->overruns, ayWorker->backend->name);
+                DSPrint(0,idx++,7, tmp);
+            }
+        }
+        else if (debug_area == 1)
         {
             sprintf(tmp, "FDC  %02X %02X %02X %02X", fdc.ST0, fdc.ST1, fdc.ST2, fdc.ST3);
             DSPrint(0,idx++,7, tmp);
@@ -530,7 +745,14 @@ void ShowDebugZ80(void)
             sprintf(tmp, "SECTOR INDEX %-3d", fdc.sector_index);
             DSPrint(0,idx++,7, tmp);
 
-            DSPrint(0,idx++,7, "                ");
+            // Memory map cache hit rate and expansion RAM banks resident/packed/untouched and switches refused for want of memory
+            u8 xr_res, xr_pack, xr_none; ram_bank_stats(&xr_res, &xr_pack, &xr_none);
+            sprintf(tmp, "M%3d%% X%d/%d/%d R%-3lu", (int)(((u64)map_hits * 100) / (map_hits + map_misses + 1)), xr_res, xr_pack, xr_none, ram_bank_refused);
+            DSPrint(0,idx++,7, tmp);
+
+            // Pre-inked table updates and entries rebuilt per second - what raster effects cost us
+            sprintf(tmp, "IK %-5lu %-7lu", ink_updates_sec, ink_entries_sec);
+            DSPrint(0,idx++,7, tmp);
         }
         else
         {
@@ -544,12 +766,16 @@ void ShowDebugZ80(void)
             DSPrint(0,idx++,7, tmp);
         }
 
-        idx++;
+        if (debug_area != 2)
+        {
+            if (debug_area == 0) idx++; // The FDC page has a fifth line where the gap would be
 
-        sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[0],  CRTC[1],  CRTC[2],  CRTC[3]);  DSPrint(0,idx++, 7, tmp);
-        sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[4],  CRTC[5],  CRTC[6],  CRTC[7]);  DSPrint(0,idx++, 7, tmp);
-        sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[8],  CRTC[9],  CRTC[10], CRTC[11]); DSPrint(0,idx++, 7, tmp);
-        sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[12], CRTC[13], CRTC[14], CRTC[15]); DSPrint(0,idx++, 7, tmp);
+            sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[0],  CRTC[1],  CRTC[2],  CRTC[3]);  DSPrint(0,idx++, 7, tmp);
+            sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[4],  CRTC[5],  CRTC[6],  CRTC[7]);  DSPrint(0,idx++, 7, tmp);
+            sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[8],  CRTC[9],  CRTC[10], CRTC[11]); DSPrint(0,idx++, 7, tmp);
+            sprintf(tmp, "CRT %02X %02X %02X %02X", CRTC[12], CRTC[13], CRTC[14], CRTC[15]); DSPrint(0,idx++, 7, tmp);
+            sprintf(tmp, "IS  %-11lu", IdleSkipped); DSPrint(0,idx++, 7, tmp);  // T-states skipped with the CPU idle
+        }
 
         // Put out the debug registers...
         idx = 2;
@@ -559,6 +785,11 @@ void ShowDebugZ80(void)
         }
         sprintf(tmp, "DX %-9lu", DX); DSPrint(17,idx++, 7, tmp);
         sprintf(tmp, "DY %-9lu", DY); DSPrint(17,idx++, 7, tmp);
+#ifdef Z80_BLOCK_CACHE
+        sprintf(tmp, "BH %-9lu", BlockHits);        DSPrint(17,idx++, 7, tmp);  // Decoded block hits
+        sprintf(tmp, "BM %-9lu", BlockMisses);      DSPrint(17,idx++, 7, tmp);  // Decoded block misses
+        sprintf(tmp, "BI %-9lu", BlockInvalidates); DSPrint(17,idx++, 7, tmp);  // Flushes and page invalidations
+#endif
     }
     else
     {
@@ -638,7 +869,7 @@ void DisplayStatusLine(bool bForce)
                             {
                                 write_num = fdc.disk_size - (4096 * i);
                             }
-                            fwrite(DISK_IMAGE_BUFFER + (4096 * i), write_num, 1, outfile);
+                            fwrite(fdc.ImgDsk + (4096 * i), write_num, 1, outfile);
                             fdc.bDirtyFlags[i] = 0;
                         }
                         else
@@ -655,6 +886,15 @@ void DisplayStatusLine(bool bForce)
         }
     }
 
+    // An expansion RAM bank switch was refused - there was no memory to pack a bank away (see ram_bank)
+    static u32 last_refused = 0;
+    if (ram_bank_refused != last_refused)
+    {
+        last_refused = ram_bank_refused;
+        DSPrint(19, 0, 6, "XRAM FULL ");
+        bClearWriteText = 1;
+    }
+
     if (last_special_key)
     {
         if (last_special_key == KBD_KEY_SFT)
@@ -680,16 +920,45 @@ void DisplayStatusLine(bool bForce)
     }
 }
 
+// -----------------------------------------------------------------
+// Tell the user a disk image was refused - it is left out of the
+// drive rather than letting it run over the expansion RAM.
+// -----------------------------------------------------------------
+static void DiskTooBig(void)
+{
+    DSPrint(18,0,0,"DISK TOO BIG ");
+    WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
+    DSPrint(18,0,0,"             ");
+}
+
 // ---------------------------------
 // Swap new disk into the drive...
 // ---------------------------------
 void DiskInsert(char *filename, u8 bForceRead)
 {
+    // The last 128K of ROM_Memory[] backs expansion RAM when there is no heap for
+    // it (DS-Lite/Phat) so a disk can't be any bigger than the rest - which still
+    // holds the biggest (896K) image plus its header.
+    const u32 disk_max = ROM_TAIL_START;
+
     amstrad_mode = MODE_DSK;
 
     if (bForceRead)
     {
-        last_file_size = ReadFileCarefully(filename, ROM_Memory, MAX_ROM_SIZE, 0);
+        struct stat stbuf;
+        if ((stat(filename, &stbuf) == 0) && (stbuf.st_size > disk_max))
+        {
+            DiskTooBig();
+            return; // Keep the disk we have
+        }
+
+        last_file_size = ReadFileCarefully(filename, ROM_Memory, disk_max, 0);
+        arena_use(ARENA_ROM, last_file_size);
+    }
+    else if (last_file_size > disk_max)
+    {
+        DiskTooBig();
+        last_file_size = 0; // Too big to leave the tail alone - the drive stays empty
     }
 
     if (last_file_size)
@@ -993,7 +1262,7 @@ u8 handle_debugger_overlay(u16 iTx, u16 iTy)
 
     if ((iTy >= 100) && (iTy <= 150))
     {
-        debug_area ^= 1;
+        debug_area = (debug_area + 1) % 3;
         WAITVBL;WAITVBL;
     }
 
@@ -1008,7 +1277,11 @@ u8 handle_debugger_overlay(u16 iTx, u16 iTy)
         if      ((iTx >= 117) && (iTx < 137))  kbd_key = '2';
         if      ((iTx >= 137) && (iTx < 168))  kbd_key = KBD_KEY_RET;
         if      ((iTx >= 168) && (iTx < 205))  return MENU_CHOICE_MENU;
+#ifdef Z80_PROFILE
+        if      ((iTx >= 205) && (iTx < 230))  {debugger_pause = 2; profile_save(); WAITVBL;}
+#else
         if      ((iTx >= 205) && (iTx < 230))  {debugger_pause = 2; WAITVBL;}
+#endif
         if      ((iTx >= 230) && (iTx < 255))  debugger_pause = 0;
 
         DisplayStatusLine(false);
@@ -1136,8 +1409,17 @@ void SugarDS_main(void)
   TIMER2_CR=0;
   TIMER2_DATA=0;
   TIMER2_CR=TIMER_ENABLE  | TIMER_DIV_1024;
+
+  // Free-running at the full bus clock to time the line drawing...
+  TIMER3_CR=0;
+  TIMER3_DATA=0;
+  TIMER3_CR=TIMER_ENABLE  | TIMER_DIV_1;
   timingFrames  = 0;
   emuFps=0;
+  emuShownFrames = 0;
+  frameStartTicks = 0;
+  framesSkipped = 0;
+  crtc_skip_frame = 0;
 
   newStreamSampleRate();
 
@@ -1279,9 +1561,32 @@ void SugarDS_main(void)
                 szChai[2] = '0' + (emuFps%100) % 10;
                 szChai[3] = 0;
                 DSPrint(28,0,6,szChai);
+
+                if (myConfig.frameSkip)
+                {
+                    // With frame skip we show how many of the frames were drawn
+                    sprintf(tmp, "%3d/", emuShownFrames);
+                    DSPrint(24,0,6,tmp);
+                }
+                else
+                {
+                    // And how many lines a frame were left alone as nothing on them changed
+                    sprintf(tmp, "%3ld", (long)(emuActFrames ? (lines_skipped / emuActFrames) : 0));
+                    DSPrint(24,0,6,tmp);
+                }
             }
             DisplayStatusLine(false);
             emuActFrames = 0;
+            emuShownFrames = 0;
+            lines_skipped = 0;
+
+            // Time spent drawing lines per frame over the last second - TIMER3 runs at 33.514MHz
+            render_us_frame = (u32)(((u64)render_ticks * 1000) / 33514) / (emuFps ? emuFps : 1);
+            render_ticks = 0;
+
+            // Pre-inked table updates and entries rebuilt over the last second for the debugger
+            ink_updates_sec = ink_updates;  ink_updates = 0;
+            ink_entries_sec = ink_entries;  ink_entries = 0;
 
             if (bFirstTime)
             {
@@ -1340,13 +1645,34 @@ void SugarDS_main(void)
         }
         emuActFrames++;
 
-        // Render the previous frame as we work on the next one...
-        if (isDSiMode())
+        // Render the previous frame as we work on the next one... unless we skipped drawing it
+        if (!crtc_skip_frame)
         {
-            backgroundRender = 0x80 | (emuTotFrames & 1);
+            emuShownFrames++;
+            if (isDSiMode())
+            {
+                backgroundRender = 0x80 | (emuTotFrames & 1);
+            }
         }
         emuTotFrames++;
 
+        // ------------------------------------------------------------------------
+        // Auto frame skip. If the frame we just emulated took longer than the
+        // target frame rate allows, the next one is run without being drawn -
+        // the CPU, CRTC and interrupts all still see every scanline. We never
+        // skip more than the configured number of frames in a row.
+        // ------------------------------------------------------------------------
+        crtc_skip_frame = 0;
+        if (myConfig.frameSkip && (framesSkipped < myConfig.frameSkip))
+        {
+            u16 frame_ticks = TIMER2_DATA - frameStartTicks;
+            if (frame_ticks > ((GAME_SPEED_PAL[myConfig.gameSpeed] * 50) / SKIP_TARGET_FPS[myConfig.skipTarget]))
+            {
+                crtc_skip_frame = 1;
+            }
+        }
+        framesSkipped = crtc_skip_frame ? (framesSkipped + 1) : 0;
+
         // --------------------------------------------------------------------
         // We only support PAL 50 frames as this is an Amstrad CPC from the UK
         // --------------------------------------------------------------------
@@ -1368,6 +1694,7 @@ void SugarDS_main(void)
         {
             if (myGlobalConfig.showFPS == 2) break;   // If Full Speed, break out...
         }
+        frameStartTicks = TIMER2_DATA;
 
       // If the Z80 Debugger is enabled, call it
       if (myGlobalConfig.debugger >= 2)
@@ -2014,6 +2341,7 @@ int main(int argc, char **argv)
   // Grab the BIOS before we try to switch any directories around...
   // -----------------------------------------------------------------
   useVRAM();
+  arena_init();
   LoadBIOSFiles();
 
   // -----------------------------------------------------------------
@@ -207,6 +207,27 @@ extern u16 mode1_scale;
 #define MODE_SNA            4
 #define MODE_MEG            5
 
+// -----------------------------------------------------------------
+// Timed events - see the scheduler in amstrad.c. Lower numbered
+// events fire first when more than one is due at the same T-state.
+// -----------------------------------------------------------------
+#define EVT_LINE_END        0       // End of scanline housekeeping (returns to caller)
+#define EVT_CRTC            1       // CRTC scanline (HSYNC) - only armed on lines that need it on time
+#define EVT_R52             2       // The HSYNC that brings the R52 counter to 52 (raster interrupt)
+#define EVT_VSYNC           3       // The HSYNC two lines after VSYNC starts (VSYNC+2 interrupt)
+#define EVT_MAX             4
+
+#define LINE_TSTATES        256     // T-states in one 64us CPC scanline
+#define SCHED_NEVER         0xFFFFFFFF  // Due time of an event that isn't armed
+
+typedef struct
+{
+    u32 due;                        // CPU.TStates at which the event fires (or SCHED_NEVER)
+    u32 period;                     // T-states between firings or 0 for a one-shot event
+} sched_event_t;
+
+extern sched_event_t sched[EVT_MAX];
+
 #define WAITVBL swiWaitForVBlank(); swiWaitForVBlank(); swiWaitForVBlank(); swiWaitForVBlank(); swiWaitForVBlank();
 
 extern unsigned char BASIC_6128[16384];
@@ -215,8 +236,6 @@ extern unsigned char AMSDOS[16384];
 extern unsigned char PARADOS[16384];
 extern unsigned char MEGALOAD[40377];
 
-extern u8 DISK_IMAGE_BUFFER[];
-
 extern u8 CRTC[];
 extern u8 CRT_Idx;
 
@@ -239,6 +258,10 @@ extern u32 border_color;
 extern u8 CRTC[0x20];
 extern u8 CRT_Idx;
 extern u8 inks_changed;
+extern u32 inks_generation;
+extern u32 lines_skipped;
+extern u8  crtc_skip_frame;
+extern u32 render_ticks;
 extern u16 refresh_tstates;
 extern u8 ink_map[256];
 
@@ -291,12 +314,34 @@ extern u8  b32K_Mode;
 extern u8 SugarDSChooseGame(u8 bDiskOnly);
 extern void CartLoad(void);
 extern void ConfigureMemory(void);
+extern void ConfigureMemoryFlush(void);
+extern u8  *ram_bank(u8 b);
+extern void ram_bank_reset(void);
+extern void ram_bank_stats(u8 *resident, u8 *packed, u8 *untouched);
+extern u32  ram_bank_refused;
+extern u32 map_hits, map_misses;
 extern void compute_pre_inked(u8 mode);
+extern void update_pre_inked(u8 mode);
+extern void ink_cache_reset(void);
+extern u16 inks_dirty;
+extern u32 ink_updates, ink_entries;
 extern void SugarDSGameOptions(bool bIsGlobal);
-extern void processDirectAudio(void);
+extern void ay_log_write(u8 value);
+extern void ay_log_frame(u32 tstates);
+extern void ay_log_rebase(u32 tstates);
+extern void ay_log_reset(void);
 extern u8 crtc_render_screen_line(void);
 extern void crtc_reset(void);
+extern void crtc_redraw_all(void);
+extern void crtc_track_writes(void);
+extern void crtc_flush_row(void);
+extern void crtc_row_interrupted(void);
 extern void crtc_r52_int(void);
+extern u8 crtc_hsync_needed(void);
+extern void sched_reset(void);
+extern u32 sched_next(void);
+extern void sched_catch_up(void);
+extern void sched_line_check(void);
 extern void BottomScreenOptions(void);
 extern void TopScreenOptions(void);
 extern void TopScreenImage(void);
@@ -24,6 +24,7 @@
 #include "AmsUtils.h"
 #include "fdc.h"
 #include "printf.h"
+#include "arena.h"
 
 u8  portA               __attribute__((section(".dtcm"))) = 0x00;
 u8  portB               __attribute__((section(".dtcm"))) = 0xFF;
@@ -54,7 +55,6 @@ u32  pre_inked_mode2b[256]  = {0};  // Not used often enough to soak up fast mem
 u32  pre_inked_mode2c[256]  = {0};  // Not used often enough to soak up fast memory
 
 u8  RAM_512k_bank = 0;      // Can be set to 1 on DSi for an additional 512K addressing
-u8 *DSi_ExpandedRAM = 0;    // The DSi will malloc 1024K for extra emulated CPC memory
 
 u8 CRTC_MASKS[0x20] = {0xFF, 0xFF, 0xFF, 0xFF,
                        0x7F, 0x1F, 0x7F, 0x7F,
@@ -82,26 +82,40 @@ u16 DAN_WaitCFG   __attribute__((section(".dtcm"))) = 0x00;   // When waiting fo
 u8  DAN_Follow    __attribute__((section(".dtcm"))) = 28;     // FollowRomEn bank for zone 0 (poor man 'ROMBOX')
 u8  DAN_WaitRET   __attribute__((section(".dtcm"))) = 0;      // Set to '1' if we wait for a RET to configure memory
 
+// ------------------------------------------------------------------------
+// One entry of the pre-inked Mode 0 and Mode 1 tables - the screen byte
+// decoded into its pixels and each pixel looked up in the current INK[].
+// ------------------------------------------------------------------------
+static inline u32 pre_ink_mode0(u32 pixel)
+{
+    u8 pixel0 = INK[((pixel & 0x80) >> 7) | ((pixel & 0x20) >> 3) | ((pixel & 0x08) >> 2) | ((pixel & 0x02) << 2)];
+    u8 pixel1 = INK[((pixel & 0x40) >> 6) | ((pixel & 0x10) >> 2) | ((pixel & 0x04) >> 1) | ((pixel & 0x01) << 3)];
+    return (pixel1 << 24) | (pixel1 << 16) | (pixel0 << 8) | (pixel0 << 0);
+}
+
+static inline u32 pre_ink_mode1(u32 pixel)
+{
+    u8 pixel0 = INK[((pixel & 0x80) >> 7) | ((pixel & 0x08) >> 2)];
+    u8 pixel1 = INK[((pixel & 0x40) >> 6) | ((pixel & 0x04) >> 1)];
+    u8 pixel2 = INK[((pixel & 0x20) >> 5) | ((pixel & 0x02) >> 0)];
+    u8 pixel3 = INK[((pixel & 0x10) >> 4) | ((pixel & 0x01) << 1)];
+    return (pixel3 << 24) | (pixel2 << 16) | (pixel1 << 8) | (pixel0 << 0);
+}
+
 ITCM_CODE void compute_pre_inked(u8 mode)
 {
     if (mode == 0) // Mode 0
     {
         for (int pixel=0; pixel < 256; pixel++)
         {
-            u8 pixel0 = INK[((pixel & 0x80) >> 7) | ((pixel & 0x20) >> 3) | ((pixel & 0x08) >> 2) | ((pixel & 0x02) << 2)];
-            u8 pixel1 = INK[((pixel & 0x40) >> 6) | ((pixel & 0x10) >> 2) | ((pixel & 0x04) >> 1) | ((pixel & 0x01) << 3)];
-            pre_inked_mode0[pixel] = (pixel1 << 24) | (pixel1 << 16) | (pixel0 << 8) | (pixel0 << 0);
+            pre_inked_mode0[pixel] = pre_ink_mode0(pixel);
         }
     }
     if (mode == 1) // Mode 1
     {
         for (int pixel=0; pixel < 256; pixel++)
         {
-            u8 pixel0 = INK[((pixel & 0x80) >> 7) | ((pixel & 0x08) >> 2)];
-            u8 pixel1 = INK[((pixel & 0x40) >> 6) | ((pixel & 0x04) >> 1)];
-            u8 pixel2 = INK[((pixel & 0x20) >> 5) | ((pixel & 0x02) >> 0)];
-            u8 pixel3 = INK[((pixel & 0x10) >> 4) | ((pixel & 0x01) << 1)];
-            pre_inked_mode1[pixel] = (pixel3 << 24) | (pixel2 << 16) | (pixel1 << 8) | (pixel0 << 0);
+            pre_inked_mode1[pixel] = pre_ink_mode1(pixel);
         }
     }
     else if (mode == 2) // Mode 2
@@ -124,32 +138,166 @@ ITCM_CODE void compute_pre_inked(u8 mode)
     }
 }
 
+// -------------------------------------------------------------------------------------
+// Raster effects will often change a pen or two on every scanline and rebuilding the
+// whole table each time adds up. The gate array keeps track of which pens changed in
+// inks_dirty and only the table entries that decode to one of those pens are redone -
+// a Mode 0 pen is in just 31 of the 256 entries. A pen the mode can't show (pens 4-15
+// in Mode 1 or 2-15 in Mode 2) needs nothing at all. When too many pens change at once
+// (or the mode changes) a handful of recently built Mode 0/1 tables are kept keyed on
+// the palette so effects that flip between a few palettes just copy the table back.
+// -------------------------------------------------------------------------------------
+#define INK_CACHE_SIZE      4
+#define INK_PARTIAL_MAX     192     // Entries we'll redo one at a time before a full rebuild
+
+typedef struct
+{
+    u8  mode;                       // 0 or 1 (0xFF when empty)
+    u8  ink[16];                    // The pens the table was built from (Mode 1 only uses 4)
+    u32 table[256];
+} ink_cache_t;
+
+u16 inks_dirty           __attribute__((section(".dtcm"))) = 0xFFFF; // Pens changed since the tables were updated
+
+u8  ink_list_mode0[16][32];         // Entries that decode to each pen (31 each)
+u8  ink_list_mode1[4][176];         // Entries that decode to each pen (175 each)
+u8  ink_list_len_mode0[16] = {0};
+u8  ink_list_len_mode1[4]  = {0};
+
+ink_cache_t ink_cache[INK_CACHE_SIZE];
+u8  ink_cache_next = 0;
+
+u32 ink_updates = 0;                // Table updates and how many entries they rebuilt - the
+u32 ink_entries = 0;                // cost that raster-heavy demos put on the renderer
+
+void ink_cache_reset(void)
+{
+    for (u8 i=0; i<INK_CACHE_SIZE; i++) ink_cache[i].mode = 0xFF;
+    inks_dirty = 0xFFFF;
+
+    if (ink_list_len_mode0[0]) return;  // The pen lists only ever need building once
+
+    for (int pixel=0; pixel < 256; pixel++)
+    {
+        u8 pen0 = ((pixel & 0x80) >> 7) | ((pixel & 0x20) >> 3) | ((pixel & 0x08) >> 2) | ((pixel & 0x02) << 2);
+        u8 pen1 = ((pixel & 0x40) >> 6) | ((pixel & 0x10) >> 2) | ((pixel & 0x04) >> 1) | ((pixel & 0x01) << 3);
+        ink_list_mode0[pen0][ink_list_len_mode0[pen0]++] = pixel;
+        if (pen1 != pen0) ink_list_mode0[pen1][ink_list_len_mode0[pen1]++] = pixel;
+
+        u8 pens = (1 << (((pixel & 0x80) >> 7) | ((pixel & 0x08) >> 2))) | (1 << (((pixel & 0x40) >> 6) | ((pixel & 0x04) >> 1))) |
+                  (1 << (((pixel & 0x20) >> 5) | ((pixel & 0x02) >> 0))) | (1 << (((pixel & 0x10) >> 4) | ((pixel & 0x01) << 1)));
+        for (u8 pen=0; pen<4; pen++)
+        {
+            if (pens & (1 << pen)) ink_list_mode1[pen][ink_list_len_mode1[pen]++] = pixel;
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------
+// Bring the pre-inked table for this mode up to date with INK[] - called by the CRTC
+// on the next scanline after any ink or mode change.
+// -------------------------------------------------------------------------------------
+ITCM_CODE void update_pre_inked(u8 mode)
+{
+    u16 dirty = inks_dirty;
+    inks_dirty = 0;
+
+    if (mode == 2) dirty &= 0x0003;
+    if (mode == 1) dirty &= 0x000F;
+    if ((dirty == 0) || (mode == 3)) return;    // Nothing this mode can show has changed
+
+    ink_updates++;
+
+    if (mode == 2)
+    {
+        compute_pre_inked(2);
+        ink_entries += 256;
+        return;
+    }
+
+    // See if changing just the entries that use the changed pens is worth it
+    u32 count = 0;
+    if (dirty != 0xFFFF)
+    {
+        for (u8 pen=0; pen<16; pen++)
+        {
+            if (dirty & (1 << pen)) count += (mode ? ink_list_len_mode1[pen&3] : ink_list_len_mode0[pen]);
+        }
+    }
+
+    if (count && (count <= INK_PARTIAL_MAX))
+    {
+        ink_entries += count;
+        for (u8 pen=0; pen<16; pen++)
+        {
+            if (!(dirty & (1 << pen))) continue;
+            if (mode == 0)
+            {
+                for (u8 i=0; i<ink_list_len_mode0[pen]; i++) pre_inked_mode0[ink_list_mode0[pen][i]] = pre_ink_mode0(ink_list_mode0[pen][i]);
+            }
+            else
+            {
+                for (u8 i=0; i<ink_list_len_mode1[pen]; i++) pre_inked_mode1[ink_list_mode1[pen][i]] = pre_ink_mode1(ink_list_mode1[pen][i]);
+            }
+        }
+        return;
+    }
+
+    // Too much has changed - take a recently built table for this palette if we have one
+    u8   pens  = mode ? 4 : 16;
+    u32 *table = mode ? pre_inked_mode1 : pre_inked_mode0;
+    for (u8 i=0; i<INK_CACHE_SIZE; i++)
+    {
+        if ((ink_cache[i].mode == mode) && (memcmp(ink_cache[i].ink, INK, pens) == 0))
+        {
+            memcpy(table, ink_cache[i].table, sizeof(ink_cache[i].table));
+            return;
+        }
+    }
+
+    compute_pre_inked(mode);
+    ink_entries += 256;
+
+    ink_cache_t *entry = &ink_cache[ink_cache_next];
+    ink_cache_next = (ink_cache_next + 1) % INK_CACHE_SIZE;
+    entry->mode = mode;
+    memcpy(entry->ink, INK, pens);
+    memcpy(entry->table, table, sizeof(entry->table));
+}
+
 // --------------------------------------------------------------------
-// We use the back-end of the DISK IMAGE BUFFER as the place to store
-// our 32 banks (0..31) of 16K each. This buffer is otherwise unused
-// when we have a cartridge inserted. In theory, we could still keep
-// the disk active for loading and limit ourselves to 400K worth of
-// .dsk space which is plenty for this emulation.
+// The 32 banks (0..31) of 16K each are used right where they sit in
+// the .CPR file in ROM_Memory[] - there is nothing to copy. Banks not
+// in the file all share one bank of zeros and any chunk shorter than
+// 16K gets a zero-padded copy. Both go just past the end of the file.
 // --------------------------------------------------------------------
 u8 *CartBankPtr[32] = {0}; // The 32 banks of 16K ROM cart chunks
 void CartLoad(void)
 {
-    u8 *cart_buffer = (u8 *) (DISK_IMAGE_BUFFER + (400 * 1024));
-
-    memset(cart_buffer, 0x00, (512 * 1024)); // Nothing out there to start...
-
     if ((ROM_Memory[0] == 'R') && (ROM_Memory[1] == 'I') && (ROM_Memory[2] == 'F') && (ROM_Memory[3] == 'F') &&
         (ROM_Memory[8] == 'A') && (ROM_Memory[9] == 'M') && (ROM_Memory[10] == 'S') && (ROM_Memory[11] == '!'))
     {
         u32 total_len = (ROM_Memory[7] << 24) | (ROM_Memory[6] << 16) | (ROM_Memory[5] << 8) | (ROM_Memory[4] << 0);
 
+        // ------------------------------------------------------------------
+        // The padding area starts on the first 16K boundary past the file
+        // with the shared bank of zeros first. Anything that won't fit in
+        // front of the reserved tail just uses the chunk unpadded.
+        // ------------------------------------------------------------------
+        u8 *pad_start = ROM_Memory + ((total_len + 8 + 0x3FFF) & ~0x3FFF);
+        u8 *pad_end   = ROM_Memory + ROM_TAIL_START;
+        u8 *pad       = pad_start;
+
+        memset(pad, 0x00, 0x4000);
+        pad += 0x4000;
+
         // ---------------------------------------------------------------------------
         // Set the 32 banks of CART memory. Not all banks need to be present and will
         // contain 0x00 values for any part of the cart not present in the .CPR file
         // ---------------------------------------------------------------------------
         for (u8 bank=0; bank<32; bank++)
         {
-            CartBankPtr[bank] = (u8 *) (cart_buffer + (0x4000 * bank));
+            CartBankPtr[bank] = pad_start;
         }
 
         u32 idx = 0x0C; // The first chunk is here...
@@ -160,15 +308,26 @@ void CartLoad(void)
             {
                 u8  bank        = ((ROM_Memory[idx+2] - '0') * 10) + (ROM_Memory[idx+3] - '0');
                 u16 chunk_size  = (ROM_Memory[idx+5] << 8) | (ROM_Memory[idx+4] << 0);
-                for (int i=0; i<chunk_size; i++)
+                if (bank < 32)
                 {
-                    CartBankPtr[bank][i] = ROM_Memory[idx+8+i];
+                    CartBankPtr[bank] = &ROM_Memory[idx+8];
+                    if ((chunk_size < 0x4000) && ((pad + 0x4000) <= pad_end))
+                    {
+                        memset(pad, 0x00, 0x4000);
+                        memcpy(pad, &ROM_Memory[idx+8], chunk_size);
+                        CartBankPtr[bank] = pad;
+                        pad += 0x4000;
+                    }
                 }
                 idx += 8 + chunk_size;
             }
             else break;
         }
+
+        arena_use(ARENA_CART, pad - ROM_Memory - arena[ARENA_ROM].used);
     }
+
+    ConfigureMemoryFlush(); // The cart banks have moved under any cached memory maps
 }
 
 
@@ -194,12 +353,268 @@ void DandanatorLoad(void)
 }
 
 
+// ----------------------------------------------------------------------------------
+// Expansion RAM bank manager for the 512K/1024K configurations. Banks 1-15 are 64K
+// each (bank 0 is the 6128's own upper 64K in RAM_Memory[]) and most games never
+// touch more than one or two of them - so a bank only gets a slot when it is first
+// mapped in. Only a handful of 64K slots are ever resident; when we run out, the
+// least recently mapped bank is packed into one of the spare buffers (or dropped
+// entirely if it is still all zeros) and unpacked again the next time it is mapped.
+//
+// All the memory - the slots and a worst-case packed buffer for every bank that can
+// be out of a slot (plus one for the swap) - is reserved at reset so that nothing is
+// allocated in the middle of an OUT. Should the heap not have had room for all of it
+// a bank switch that would need more is refused (the MMR write is ignored) and shown
+// on the status line rather than quietly losing the bank. Packing runs of zero words
+// can't use lzav as the save states do - that wants an 8K hash table on the stack and
+// we don't have that much DTCM to spare.
+// ----------------------------------------------------------------------------------
+#define RAM_BANKS       16      // Bank 0 is RAM_Memory[] so only 1-15 are managed here
+#define RAM_SLOTS       8       // The DSi keeps 8 resident (the DS-Lite/Phat only 2)
+#define RAM_PACK_WORST  (0x10000 + 4)   // No two zero words in a row - one run of every word
+#define RAM_HEAP_SPARE  (256*1024)      // Heap left alone for save states and big files
+
+typedef struct
+{
+    u8  *packed;                // Packed copy of the bank when not resident
+    u32  packed_len;
+    u8   slot;                  // Slot+1 when resident, else 0
+} ram_bank_t;
+
+ram_bank_t ram_banks[RAM_BANKS];
+u8  *ram_slot_mem[RAM_SLOTS]  = {0};
+u8   ram_slot_bank[RAM_SLOTS] = {0};    // Bank in each slot (0 if free)
+u32  ram_slot_used[RAM_SLOTS] = {0};    // When each slot was last mapped in
+u8   ram_slot_count = 0;                // Slots with memory behind them
+u32  ram_slot_clock = 0;
+u8  *ram_pack_buf[RAM_BANKS]  = {0};    // The reserved packed buffers...
+u8   ram_pack_count = 0;
+u8  *ram_pack_free[RAM_BANKS] = {0};    // ...and those not holding a bank
+u8   ram_pack_free_count = 0;
+u32  ram_bank_refused = 0;              // Bank switches refused as there was nowhere to pack a bank
+
+extern int getMemFree(void);
+
+// -------------------------------------------------------------------------
+// Tell the memory arena what the expansion banks have reserved and how
+// much of it they are really using.
+// -------------------------------------------------------------------------
+static void ram_bank_budget(void)
+{
+    u32 bytes = 0;
+    for (u8 b=1; b<RAM_BANKS; b++)
+    {
+        bytes += ram_banks[b].slot ? 0x10000 : ram_banks[b].packed_len;
+    }
+    arena[ARENA_XRAM].size = (ram_slot_count * 0x10000) + (ram_pack_count * RAM_PACK_WORST);
+    arena_use(ARENA_XRAM, bytes);
+}
+
+// -------------------------------------------------------------------------
+// Reserve the slots and the packed buffers - this machine's expansion banks
+// less the slots, plus one as the bank going out is packed before the one
+// coming in gives its buffer back. Done at reset and only ever tops up what
+// we have. The first two slots can fall back on the end of ROM_Memory[].
+// -------------------------------------------------------------------------
+static void ram_bank_reserve(void)
+{
+    u8 banks = isDSiMode() ? (RAM_BANKS-1) : 7;
+    u8 slots = isDSiMode() ? RAM_SLOTS : ROM_TAIL_SLOTS;
+
+    while (ram_slot_count < slots)
+    {
+        u8 *mem = (getMemFree() > (0x10000 + RAM_HEAP_SPARE)) ? malloc(0x10000) : 0;
+        if (!mem && (ram_slot_count < ROM_TAIL_SLOTS)) mem = ROM_Memory + ROM_TAIL_START + ROM_TAIL_RESERVE - ((ram_slot_count+1) * 0x10000);
+        if (!mem) break;
+        ram_slot_mem[ram_slot_count++] = mem;
+    }
+
+    while (ram_pack_count < (banks - ram_slot_count + 1))
+    {
+        u8 *mem = (getMemFree() > (RAM_PACK_WORST + RAM_HEAP_SPARE)) ? malloc(RAM_PACK_WORST) : 0;
+        if (!mem) break;
+        ram_pack_buf[ram_pack_count++] = mem;
+    }
+}
+
+// -------------------------------------------------------------------------
+// A packed bank is a list of runs: a u16 count of zero words followed by a
+// u16 count of literal words and then the literal words themselves. Returns
+// the packed length in bytes - zero if the whole bank is zero.
+// -------------------------------------------------------------------------
+static u32 ram_bank_pack(u32 *src, u32 *dst)
+{
+    u32 i = 0, len = 0;
+
+    while (i < 0x10000/4)
+    {
+        u32 zeros = 0, literals = 0;
+        while ((i < 0x10000/4) && (src[i] == 0)) {zeros++; i++;}
+        if (i == 0x10000/4) break;
+        while ((i+literals < 0x10000/4) && (src[i+literals] || ((i+literals+1 < 0x10000/4) && src[i+literals+1]))) literals++;
+        dst[len++] = zeros | (literals << 16);
+        memcpy(&dst[len], &src[i], literals * 4);
+        len += literals; i += literals;
+    }
+
+    return len * 4;
+}
+
+static void ram_bank_unpack(u32 *src, u32 len, u32 *dst)
+{
+    u32 *end = src + len/4;
+    u32 *dst_end = dst + 0x10000/4;
+
+    while (src < end)
+    {
+        u32 zeros = *src & 0xFFFF, literals = *src++ >> 16;
+        memset(dst, 0x00, zeros * 4); dst += zeros;
+        memcpy(dst, src, literals * 4); dst += literals; src += literals;
+    }
+    memset(dst, 0x00, (dst_end - dst) * 4); // The trailing run of zeros is implied
+}
+
+static u8 ram_bank_empty(u32 *src)
+{
+    for (u32 i=0; i<0x10000/4; i++) if (src[i]) return 0;
+    return 1;
+}
+
+// -------------------------------------------------------------------------
+// Pack away whatever bank lives in this slot so the slot can be reused.
+// Returns 0 (and the bank stays resident) if there is no buffer left to
+// pack it into and it isn't all zeros - which are simply forgotten.
+// -------------------------------------------------------------------------
+static u8 ram_slot_evict(u8 slot)
+{
+    u8 b = ram_slot_bank[slot];
+    if (b == 0) return 1;
+
+    if (ram_pack_free_count)
+    {
+        u8 *packed = ram_pack_free[ram_pack_free_count-1];
+        u32 len = ram_bank_pack((u32 *)ram_slot_mem[slot], (u32 *)packed);
+        if (len)
+        {
+            ram_pack_free_count--;
+            ram_banks[b].packed = packed;
+            ram_banks[b].packed_len = len;
+        }
+    }
+    else if (!ram_bank_empty((u32 *)ram_slot_mem[slot])) return 0;
+
+    ram_banks[b].slot = 0;
+    ram_slot_bank[slot] = 0;
+    return 1;
+}
+
+// -------------------------------------------------------------------------
+// Find a slot for a bank coming in - a free one if we have it, else the
+// one mapped in longest ago whose bank can be packed away. Returns 0xFF if
+// nothing can be packed away - there is no memory that is ours to use.
+// -------------------------------------------------------------------------
+static u8 ram_slot_take(void)
+{
+    u8 tried = 0;   // Slots whose bank couldn't be packed away
+
+    for (;;)
+    {
+        u8 slot = 0xFF;
+        for (u8 i=0; i<ram_slot_count; i++)
+        {
+            if (tried & (1 << i)) continue;
+            if (ram_slot_bank[i] == 0) {slot = i; break;}
+            if ((slot == 0xFF) || (ram_slot_used[i] < ram_slot_used[slot])) slot = i;
+        }
+
+        if (slot == 0xFF) return 0xFF;
+        if (ram_slot_evict(slot)) return slot;
+        tried |= (1 << slot);
+    }
+}
+
+// -------------------------------------------------------------------------
+// Return the 64K of memory for an expansion bank, bringing it in first if
+// needed. The memory maps and decoded Z80 blocks may point into the slot
+// we reuse so they are flushed - ConfigureMemory() must be called after.
+// Returns NULL (and counts it) if the bank can't be brought in.
+// -------------------------------------------------------------------------
+u8 *ram_bank(u8 b)
+{
+    u8 slot = ram_banks[b].slot;
+
+    if (slot == 0)
+    {
+        slot = ram_slot_take();
+        if (slot == 0xFF)
+        {
+            ram_bank_refused++;
+            return 0;
+        }
+
+        if (ram_banks[b].packed)
+        {
+            ram_bank_unpack((u32 *)ram_banks[b].packed, ram_banks[b].packed_len, (u32 *)ram_slot_mem[slot]);
+            ram_pack_free[ram_pack_free_count++] = ram_banks[b].packed;
+            ram_banks[b].packed = 0;
+            ram_banks[b].packed_len = 0;
+        }
+        else memset(ram_slot_mem[slot], 0x00, 0x10000);
+
+        ram_slot_bank[slot] = b;
+        ram_banks[b].slot = slot+1;
+        ram_bank_budget();
+
+        ConfigureMemoryFlush();
+        FlushZ80();
+    }
+    else slot--;
+
+    ram_slot_used[slot] = ++ram_slot_clock;
+
+    return ram_slot_mem[slot];
+}
+
+// -------------------------------------------------------------------------
+// All expansion banks back to untouched (zero) - the slots and packed
+// buffers are kept (and reserved now if we don't have them yet).
+// -------------------------------------------------------------------------
+void ram_bank_reset(void)
+{
+    ram_bank_reserve();
+
+    memset(ram_banks, 0x00, sizeof(ram_banks));
+    memset(ram_slot_bank, 0x00, sizeof(ram_slot_bank));
+    memset(ram_slot_used, 0x00, sizeof(ram_slot_used));
+    memcpy(ram_pack_free, ram_pack_buf, sizeof(ram_pack_free));
+    ram_pack_free_count = ram_pack_count;
+    ram_slot_clock = 0;
+    ram_bank_budget();
+
+    ConfigureMemoryFlush();
+    FlushZ80();
+}
+
+// -------------------------------------------------------------------------
+// How many expansion banks are resident, packed away or never touched.
+// -------------------------------------------------------------------------
+void ram_bank_stats(u8 *resident, u8 *packed, u8 *untouched)
+{
+    *resident = *packed = *untouched = 0;
+    for (u8 b=1; b<(isDSiMode() ? RAM_BANKS : 8); b++)
+    {
+        if (ram_banks[b].slot)        (*resident)++;
+        else if (ram_banks[b].packed) (*packed)++;
+        else                          (*untouched)++;
+    }
+}
+
 // -Address-     0      1      2      3      4      5      6      7
 // 0000-3FFF   RAM_0  RAM_0  RAM_4  RAM_0  RAM_0  RAM_0  RAM_0  RAM_0
 // 4000-7FFF   RAM_1  RAM_1  RAM_5  RAM_3  RAM_4  RAM_5  RAM_6  RAM_7
 // 8000-BFFF   RAM_2  RAM_2  RAM_6  RAM_2  RAM_2  RAM_2  RAM_2  RAM_2
 // C000-FFFF   RAM_3  RAM_7  RAM_7  RAM_7  RAM_3  RAM_3  RAM_3  RAM_3
-ITCM_CODE void ConfigureMemory(void)
+static void ResolveMemoryMap(u8 bank)
 {
     u8 *LROM_Ptr = (u8 *) OS_6128;
     u8 *UROM_Ptr = (u8 *) BASIC_6128;
@@ -239,57 +654,8 @@ ITCM_CODE void ConfigureMemory(void)
         LROM_Ptr = CartBankPtr[0];
     }
 
-    u8 *upper_ram_block = RAM_Memory+0x10000;
-
-    // ------------------------------------------------------------------
-    // For the DS-Lite/Phat, if a game calls for more than the standard
-    // 128K of RAM found in a CPC 6128, we start to steal blocks of 64K
-    // from the back-end of the ROM_Memory[] buffer. The hope is that
-    // we would not need to use both that much ROM_Memory[] and extended
-    // RAM_Memory[] at the same time... but this is a compromise as we
-    // have limited RAM. Steal the 64K blocks starting at the far (back)
-    // end of the buffer so there is less chance of the two memory ends
-    // meeting and causing a catastrophe of biblical proportions.
-    // ------------------------------------------------------------------
-    u8 bank = RAM_512k_bank | ((MMR >> 3) & 0x7);
-    if (bank > ram_highwater) ram_highwater = bank;
-
-    if (isDSiMode()) // DSi has plenty of memory so we don't need to steal from the ROM_Memory[]
-    {
-        switch (bank)
-        {
-            case 0:  upper_ram_block = RAM_Memory+0x10000; break;
-            case 1:  upper_ram_block = DSi_ExpandedRAM+0x00000; break;
-            case 2:  upper_ram_block = DSi_ExpandedRAM+0x10000; break;
-            case 3:  upper_ram_block = DSi_ExpandedRAM+0x20000; break;
-            case 4:  upper_ram_block = DSi_ExpandedRAM+0x30000; break;
-            case 5:  upper_ram_block = DSi_ExpandedRAM+0x40000; break;
-            case 6:  upper_ram_block = DSi_ExpandedRAM+0x50000; break;
-            case 7:  upper_ram_block = DSi_ExpandedRAM+0x60000; break;
-            case 8:  upper_ram_block = DSi_ExpandedRAM+0x70000; break;
-            case 9:  upper_ram_block = DSi_ExpandedRAM+0x80000; break;
-            case 10: upper_ram_block = DSi_ExpandedRAM+0x90000; break;
-            case 11: upper_ram_block = DSi_ExpandedRAM+0xA0000; break;
-            case 12: upper_ram_block = DSi_ExpandedRAM+0xB0000; break;
-            case 13: upper_ram_block = DSi_ExpandedRAM+0xC0000; break;
-            case 14: upper_ram_block = DSi_ExpandedRAM+0xD0000; break;
-            case 15: upper_ram_block = DSi_ExpandedRAM+0xE0000; break;
-        }
-    }
-    else // DS-Lite/Phat we steal memory from the ROM_Memory[]
-    {
-        switch (bank & 7)
-        {
-            case 0: upper_ram_block = RAM_Memory+0x10000; break;
-            case 1: upper_ram_block = ROM_Memory+0xF0000; break;
-            case 2: upper_ram_block = ROM_Memory+0xE0000; break;
-            case 3: upper_ram_block = ROM_Memory+0xD0000; break;
-            case 4: upper_ram_block = ROM_Memory+0xC0000; break;
-            case 5: upper_ram_block = ROM_Memory+0xB0000; break;
-            case 6: upper_ram_block = ROM_Memory+0xA0000; break;
-            case 7: upper_ram_block = ROM_Memory+0x90000; break;
-        }
-    }
+    // Bank 0 is the 6128's own upper 64K - the rest come from the bank manager
+    u8 *upper_ram_block = bank ? ram_bank(bank) : (RAM_Memory+0x10000);
 
     // ----------------------------------------------------------------------
     // The heart of the memory management system utilizes MMR to tell us
@@ -483,6 +849,88 @@ ITCM_CODE void ConfigureMemory(void)
     MemoryMapW[3] -= 0xC000;
 }
 
+// ----------------------------------------------------------------------------------
+// Resolving the map above is a fair bit of work and ConfigureMemory() is called on
+// every RMR/MMR/UROM write - some games and demos bank switch every few scanlines.
+// The handful of configurations a game actually uses are kept fully resolved in a
+// small direct-mapped cache keyed on everything the map depends upon so a remap is
+// usually just copying 8 pointers. Anything that moves the memory behind the keys
+// (cart banks, expanded RAM) must call ConfigureMemoryFlush().
+// ----------------------------------------------------------------------------------
+#define MAP_CACHE_SIZE  64      // Must be a power of 2
+
+typedef struct
+{
+    u32 key;                    // MMR/RMR/UROM/bank/mode - zero is never a valid key
+    u32 dan;                    // Dandanator zones and config (zero if not a DAN game)
+    u8 *R[4];
+    u8 *W[4];
+} map_cache_t;
+
+map_cache_t map_cache[MAP_CACHE_SIZE];
+u32 map_hits    = 0;
+u32 map_misses  = 0;
+
+void ConfigureMemoryFlush(void)
+{
+    memset(map_cache, 0x00, sizeof(map_cache));
+}
+
+// ------------------------------------------------------------------
+// The expansion bank the MMR maps in (0 for none). The DS-Lite/Phat
+// only has room for 512K (7 extra banks) so wraps. Config 0 never
+// maps the upper 64K and so doesn't need it resident.
+// ------------------------------------------------------------------
+static inline u8 mmr_bank(void)
+{
+    u8 bank = RAM_512k_bank | ((MMR >> 3) & 0x7);
+    if (!isDSiMode()) bank &= 7;
+    if ((MMR & 0x07) == 0) bank = 0;
+    return bank;
+}
+
+ITCM_CODE void ConfigureMemory(void)
+{
+    u8 bank = RAM_512k_bank | ((MMR >> 3) & 0x7);
+    if (bank > ram_highwater) ram_highwater = bank;
+
+    // ------------------------------------------------------------------
+    // Make sure the bank is resident (and freshly used) before we look
+    // for the map - bringing a bank in empties the map cache. The MMR
+    // write already refused a bank that can't come in so this only
+    // fails after a save state has shuffled the banks - see ram_bank().
+    // ------------------------------------------------------------------
+    bank = mmr_bank();
+    if (bank && !ram_bank(bank)) bank = 0;
+
+    u32 key = 0x80000000 | (amstrad_mode << 24) | (myGlobalConfig.diskROM << 20) | (bank << 16) | (UROM << 8) | ((MMR & 0x07) << 4) | (RMR & 0x0C);
+    u32 dan = 0;
+    if (amstrad_mode == MODE_DAN)
+    {
+        dan = ((DAN_Config & 0x3F) << 24) | ((DAN_Zone1 & 0x3F) << 16) | ((DAN_Zone0 & 0x3F) << 8) | DAN_Follow;
+    }
+
+    map_cache_t *entry = &map_cache[(key ^ (key >> 8) ^ (key >> 16) ^ dan ^ (dan >> 16)) & (MAP_CACHE_SIZE-1)];
+    if ((entry->key == key) && (entry->dan == dan))
+    {
+        map_hits++;
+        memcpy(MemoryMapR, entry->R, sizeof(entry->R));
+        memcpy(MemoryMapW, entry->W, sizeof(entry->W));
+    }
+    else
+    {
+        map_misses++;
+        ResolveMemoryMap(bank);
+        entry->key = key;
+        entry->dan = dan;
+        memcpy(entry->R, MemoryMapR, sizeof(entry->R));
+        memcpy(entry->W, MemoryMapW, sizeof(entry->W));
+    }
+
+    crtc_track_writes(); // Screen writes are stamped through the new map
+    RemapZ80(); // Let the Z80 core know in case it has cached code from the old map
+}
+
 // Keyboard Matrix... Scan row is PortC and read returned on PortA (low bits active)
 //Bit:      7       6       5       4       3       2       1       0
 //&40       F Dot   ENTER   F3      F6      F9      CURDN   CURRT   CURUP
@@ -707,6 +1155,16 @@ ITCM_CODE unsigned char cpu_readport_ams(register unsigned short Port)
 // #BFXX    %x0xxxx11 xxxxxxxx  6845 CRTC Data In (as far as supported) - Read
 // -----------------------------------------------------------------------------
 
+// -------------------------------------------------------------------------
+// The AY data writes always go straight to myAY (so they read back) and with
+// WAVE DIRECT sound they are also queued with the CPU time for the worker.
+// -------------------------------------------------------------------------
+static inline void psg_data_write(void)
+{
+    ay38910DataW(portA, &myAY);
+    if (myConfig.waveDirect) ay_log_write(portA);
+}
+
 ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned char Value)
 {
     if (!(Port & 0x0800)) // PPI / PSG
@@ -717,7 +1175,7 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                 portA = Value;
                 if ((portC & 0xC0) == 0x80) // AY Data Write into Register
                 {
-                    ay38910DataW(portA, &myAY);
+                    psg_data_write();
                 }
 
                 if ((portC & 0xC0) == 0xC0) // AY Register Select
@@ -738,7 +1196,7 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                 {
                     if ((portC & 0xC0) == 0x80) // AY Data Write into Register
                     {
-                        ay38910DataW(portA, &myAY);
+                        psg_data_write();
                     }
 
                     if ((portC & 0xC0) == 0xC0) // AY Register Select
@@ -783,12 +1241,15 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                 break;
 
             case 0x01:
+                sched_catch_up(); // An HSYNC already past must see the old value
+                if (CRTC[CRT_Idx] != (Value & CRTC_MASKS[CRT_Idx])) crtc_row_interrupted(); // Draw the row so far as it was
                 CRTC[CRT_Idx] = Value & CRTC_MASKS[CRT_Idx];
                 if (CRT_Idx == 9)
                 {
                     // On CRTC 0/3 if we write R[9] lower than VLC, then VLC resets to zero
                     if (CRTC[9] < VLC)  VLC = 0;
                 }
+                sched_line_check(); // And one still to come may now need to be on time
                 break;
         }
     }
@@ -805,14 +1266,22 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                 if (PENR & 0x10)
                 {
                     INK[16] = ink_map[Value & 0x1F];
-                    border_color = (INK[16] << 24) | (INK[16] << 16) | (INK[16] << 8) | (INK[16] << 0);
+                    u32 border = (INK[16] << 24) | (INK[16] << 16) | (INK[16] << 8) | (INK[16] << 0);
+                    if (border != border_color)
+                    {
+                        crtc_row_interrupted();
+                        inks_generation++; // Lines with a border strip need redrawing
+                    }
+                    border_color = border;
                 }
                 else
                 {
                     if (INK[PENR & 0xF] != ink_map[Value & 0x1F])
                     {
+                        crtc_row_interrupted();
                         INK[PENR & 0xF] = ink_map[Value & 0x1F];
                         inks_changed = 1;
+                        inks_dirty |= (1 << (PENR & 0xF));
                     }
                 }
                 break;
@@ -821,18 +1290,23 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                 // Are we changing graphic modes?
                 if ((RMR & 0x03) != (Value & 0x03))
                 {
+                    crtc_row_interrupted();
                     inks_changed = 1; // Force ink change
+                    inks_dirty = 0xFFFF; // The new mode's table may be from any old palette
                 }
 
                 RMR = Value;
                 if (RMR & 0x10)
                 {
+                    sched_catch_up(); // Count any HSYNC already past first
                     R52 = 0; // Force R52 counter to zero...
                 }
                 ConfigureMemory();
                 break;
 
             case 0x03:  // MMR - RAM Memory Mapping
+            {
+                u8 old_MMR = MMR, old_512k_bank = RAM_512k_bank;
                 MMR = Value;
                 if (isDSiMode()) // DS-Lite/Phat only supports the 512K expansion
                 {
@@ -844,8 +1318,17 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
                     // -----------------------------------------------------------------------------
                     RAM_512k_bank = (Port & 0x100) ? 0x00:0x08; // Bit 8 is inverted here
                 }
+
+                // No memory to bring the bank in (see ram_bank) - refuse the switch
+                if (mmr_bank() && !ram_bank(mmr_bank()))
+                {
+                    MMR = old_MMR;
+                    RAM_512k_bank = old_512k_bank;
+                    break;
+                }
                 ConfigureMemory();
                 break;
+            }
         }
     }
 
@@ -873,14 +1356,7 @@ ITCM_CODE void cpu_writeport_ams(register unsigned short Port,register unsigned
 // ----------------------------------------------------------------------
 void amstrad_reset(void)
 {
-    if (isDSiMode())
-    {
-        if (!DSi_ExpandedRAM)
-        {
-            DSi_ExpandedRAM = malloc(1024*1024); // Grab an extra 1024K of RAM for the DSi which will support 1024K+64K of emulated CPC memory
-        }
-        memset(DSi_ExpandedRAM, 0x00, 1024*1024); // Clear all expanded RAM
-    }
+    ram_bank_reset(); // All expanded RAM banks back to zero
 
     ResetFDC();
 
@@ -935,6 +1411,8 @@ void amstrad_reset(void)
     ink_map[0x09] = 31;
 
     for (int i=0; i<32; i++) CartBankPtr[i] = (u8*)0;
+    arena_use(ARENA_CART, 0);
+    ConfigureMemoryFlush();
 
     crtc_reset();
 
@@ -950,6 +1428,7 @@ void amstrad_reset(void)
     portDIR             = 0x00;
 
     scanline_count = 1;
+    sched_reset();
 
     sna_last_motor = 0;
     sna_last_track = 0;
@@ -962,6 +1441,7 @@ void amstrad_reset(void)
 
     border_color = (INK[16] << 24) | (INK[16] << 16) | (INK[16] << 8) | (INK[16] << 0);
 
+    ink_cache_reset();
     compute_pre_inked(0);
     compute_pre_inked(1);
     compute_pre_inked(2);
@@ -1210,69 +1690,287 @@ void amstrad_reset(void)
         }
     }
 
+    crtc_redraw_all(); // Screen RAM may have been loaded behind the CPU's back
+
     return;
 }
 
 
+// -----------------------------------------------------------------------------------
+// A small event scheduler. Everything that must happen at a fixed point in CPU time
+// is an event with a due time in T-states. amstrad_run() runs the Z80 straight up to
+// the earliest pending event, fires whatever is due (lowest event number first) and
+// repeats until the end of the scanline. The line end re-arms itself as it fires and
+// the rest are one-shot events that go back to SCHED_NEVER once they have fired.
+//
+// Each line has one HSYNC half way along where the CRTC counters move on (and the
+// line is drawn) but the Z80 is only stopped there when it matters - when the line
+// is drawn, or the CRTC is about to change something the CPU can see (see
+// crtc_hsync_needed), or one of the two interrupts is due. The R52 interrupt and the
+// VSYNC+2 interrupt are counted in whole lines so they get one-shot events of their
+// own, armed as far ahead as we know. Any other HSYNC waits for the end of the line
+// unless the CPU writes to the CRTC or resets R52 after it should have happened -
+// then sched_catch_up() runs it first. The FDC ticks once per frame and not on any
+// CPU time so that one stays with the frame handling in SugarDS.c.
+// -----------------------------------------------------------------------------------
+sched_event_t sched[EVT_MAX] __attribute__((section(".dtcm")));
+
+u32 hsync_due       __attribute__((section(".dtcm"))) = 0;    // When this line's HSYNC happens
+u8  hsync_pending   __attribute__((section(".dtcm"))) = 0;    // Set until this line's HSYNC has been run
+u8  hsync_vsync     __attribute__((section(".dtcm"))) = 0;    // The HSYNC said the frame is done
+
+// ----------------------------------------------------------------------------
+// Arm a one-shot event to fire at the given T-state (replacing any earlier one)
+// ----------------------------------------------------------------------------
+static inline void sched_event(u8 event, u32 due)
+{
+    sched[event].due    = due;
+    sched[event].period = 0;
+}
+
+// ----------------------------------------------------------------------------
+// A new line starts at the end of the last one. Only stop the Z80 at its HSYNC
+// if the CRTC says the line needs it - otherwise it will be run at the line end.
+// ----------------------------------------------------------------------------
+static inline void sched_line_start(void)
+{
+    hsync_due = sched[EVT_LINE_END].due - (LINE_TSTATES/2);
+    hsync_pending = 1;
+    sched_event(EVT_CRTC, crtc_hsync_needed() ? hsync_due : SCHED_NEVER);
+}
+
+// ----------------------------------------------------------------------------
+// Run this line's HSYNC - the CRTC counters, the interrupts and the drawing -
+// and then arm the interrupt events from where the counters now stand.
+// ----------------------------------------------------------------------------
+ITCM_CODE static void sched_hsync(void)
+{
+    hsync_pending = 0;
+    sched[EVT_CRTC].due = SCHED_NEVER;
+
+    if (crtc_render_screen_line()) hsync_vsync = 1;
+
+    // R52 counts one more each HSYNC and interrupts when it reaches 52. Anything
+    // else that changes it (a reset or an EI clearing bit 5) only makes it later
+    // so an early event is harmless - the HSYNC it stops at will re-arm it.
+    sched_event(EVT_R52, hsync_due + (52 - (R52 & 0x3F)) * LINE_TSTATES);
+    sched_event(EVT_VSYNC, vsync_plus_two ? (hsync_due + vsync_plus_two * LINE_TSTATES) : SCHED_NEVER);
+}
+
+// ----------------------------------------------------------------------------
+// The CPU is about to change the CRTC or R52. If this line's HSYNC should have
+// happened already it must see things as they were - so run it now. When it is
+// armed as an event it will be run the moment this instruction finishes (as it
+// always was) and that way no interrupt is ever fired in the middle of an I/O.
+// ----------------------------------------------------------------------------
+ITCM_CODE void sched_catch_up(void)
+{
+    if (hsync_pending && (CPU.TStates >= hsync_due))
+    {
+        if ((sched[EVT_CRTC].due == hsync_due) || (sched[EVT_R52].due == hsync_due) || (sched[EVT_VSYNC].due == hsync_due)) return;
+        sched_hsync();
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The CPU has changed the CRTC. If this line's HSYNC is still to come, have
+// another look at whether it now needs to be on time.
+// ----------------------------------------------------------------------------
+ITCM_CODE void sched_line_check(void)
+{
+    if (hsync_pending && (CPU.TStates < hsync_due) && crtc_hsync_needed()) sched_event(EVT_CRTC, hsync_due);
+}
+
+// ----------------------------------------------------------------------------
+// Arm the events with the line starting at the current CPU.Target which is
+// always where the previous line finished (or zero after a reset). We don't
+// know where R52 or VSYNC stand so the first HSYNC is run on time.
+// ----------------------------------------------------------------------------
+void sched_reset(void)
+{
+    sched[EVT_LINE_END].due    = CPU.Target + LINE_TSTATES;
+    sched[EVT_LINE_END].period = LINE_TSTATES;
+
+    sched_event(EVT_R52,   SCHED_NEVER);
+    sched_event(EVT_VSYNC, SCHED_NEVER);
+
+    sched_line_start();
+    sched_event(EVT_CRTC, hsync_due);
+    hsync_vsync = 0;
+
+    ay_log_reset(); // The WAVE DIRECT sound runs off the same clock
+}
+
+// ------------------------------------------------------------
+// When is the next event due? There is always a line end.
+// ------------------------------------------------------------
+ITCM_CODE u32 sched_next(void)
+{
+    u32 next = sched[EVT_LINE_END].due;
+
+    for (u8 event=EVT_LINE_END+1; event<EVT_MAX; event++)
+    {
+        if (sched[event].due < next) next = sched[event].due;
+    }
+
+    return next;
+}
+
 // -----------------------------------------------------------------------------
 // Run the emulation for exactly 1 scanline and handle the VDP interrupt if
 // the emulation has executed the last line of the frame.
 //
-// We also process 1 line worth of Audio and render one screen line for
-// the CRTC display controller. This is a carefully choreographed dance
-// between the CRTC controller, audio processor and CPU - and as with most
-// emulation - it's not perfect. We have a few tweaks/tricks that can be
+// We also render one screen line for the CRTC display controller and at the
+// end of the frame the WAVE DIRECT audio. This is a carefully choreographed
+// dance between the CRTC controller, audio processor and CPU - and as with
+// most emulation - it's not perfect. We have a few tweaks/tricks that can be
 // configured to help keep things in alignment and keep the game running.
+//
+// The choreography itself lives in the event schedule (see sched_reset) - the
+// CRTC half way through the line so we are never more than half a line "wrong"
+// (good enough for 98% of CPC games) and then the end of line housekeeping.
 // -----------------------------------------------------------------------------
 ITCM_CODE u32 amstrad_run(void)
 {
-    // Process 1 scanline worth of AY audio
-    if (myConfig.waveDirect) processDirectAudio();
-
-    // -----------------------------------------------------------------------
-    // Execute half of the current scanline - we do this to get as close
-    // to accurate as possible - half the CPU line, then the CRTC line
-    // then the back-half of the CPU line. This way we're no more than half
-    // a line "wrong" at any time which is good enough for 98% of CPC games.
-    // -----------------------------------------------------------------------
-    CPU.Target += 128;
-    ExecZ80(CPU.Target);
-
-    // Process 1 scanline for the mighty CRTC controller chip
-    u8 vsync = crtc_render_screen_line();
-
-    // Finish the scanline plus any user-called for adjustment...
-    CPU.Target += 128;
-    ExecZ80(CPU.Target);
-
-    if (vsync) // Will return non-zero if VSYNC started
+    while (1)
     {
-        if (++refresh_tstates & 0x10) // Every 16 Frames, reset counters to prevent overflow
+        // Run the CPU right up to the next event...
+        CPU.Target = sched_next();
+        ExecZ80(CPU.Target);
+
+        // And fire everything that is now due
+        for (u8 event=0; event<EVT_MAX; event++)
         {
-            refresh_tstates = 0;
-            CPU.TStates = CPU.TStates - CPU.Target;
-            CPU.Target = 0;
-
-            // ---------------------------------------------------------------------------
-            // If we came up significantly short we make an attempt to adjust the VCC to
-            // put the CPU and CRTC back into alignment. Due to the line-based emulation,
-            // if things are not firing perfectly on games that have very tight timings,
-            // we can end up with a mess. This is a last ditch effort to get the system
-            // running by skewing the CRTC VCC counter and the CPU line-based emulation.
-            // The one game that definitely is improved by this is Galactic Tomb 128K.
-            // ---------------------------------------------------------------------------
-            if (scanline_count < (250 * 16))
+            if (sched[event].due > CPU.Target) continue;
+
+            if (sched[event].period) sched[event].due += sched[event].period;
+            else sched[event].due = SCHED_NEVER;
+
+            switch (event)
             {
-                VCC = 0; // Shock the monkey!
-                VLC = 0;
-                R52 = 0;
+                case EVT_CRTC:  // Process 1 scanline for the mighty CRTC controller chip
+                case EVT_R52:   // along with the raster interrupt...
+                case EVT_VSYNC: // or the VSYNC+2 interrupt
+                    if (hsync_pending) sched_hsync();
+                    break;
+
+                case EVT_LINE_END:
+                    if (hsync_pending) sched_hsync(); // Nothing needed it on time
+
+                    u8 vsync = hsync_vsync;
+                    hsync_vsync = 0;
+
+                    if (vsync) // Will be non-zero if VSYNC started
+                    {
+                        ay_log_frame(CPU.Target); // Have the frame worth of WAVE DIRECT sound rendered
+
+                        if (++refresh_tstates & 0x10) // Every 16 Frames, reset counters to prevent overflow
+                        {
+                            refresh_tstates = 0;
+                            CPU.TStates = CPU.TStates - CPU.Target;
+                            for (u8 i=0; i<EVT_MAX; i++)
+                            {
+                                if (sched[i].due != SCHED_NEVER) sched[i].due -= CPU.Target;
+                            }
+                            ay_log_rebase(CPU.Target);
+                            CPU.Target = 0;
+
+                            // ---------------------------------------------------------------------------
+                            // If we came up significantly short we make an attempt to adjust the VCC to
+                            // put the CPU and CRTC back into alignment. Due to the line-based emulation,
+                            // if things are not firing perfectly on games that have very tight timings,
+                            // we can end up with a mess. This is a last ditch effort to get the system
+                            // running by skewing the CRTC VCC counter and the CPU line-based emulation.
+                            // The one game that definitely is improved by this is Galactic Tomb 128K.
+                            // ---------------------------------------------------------------------------
+                            if (scanline_count < (250 * 16))
+                            {
+                                VCC = 0; // Shock the monkey!
+                                VLC = 0;
+                                R52 = 0;
+                            }
+                            scanline_count = 0; // Will be incremented to 1 directly below
+                        }
+                    }
+                    scanline_count++;
+
+                    sched_line_start(); // The next line starts here
+
+                    return vsync; // Return '1' if end of frame.. '0' if not end of frame
             }
-            scanline_count = 0; // Will be incremented to 1 directly below
         }
     }
-    scanline_count++;
+}
 
-    return vsync; // Return '1' if end of frame.. '0' if not end of frame
+#ifdef Z80_PROFILE
+// ------------------------------------------------------------------------------
+// Put a name to one of the banks the Z80 profiler has seen. We know where all
+// of the ROMs and RAM live so we can tell them apart by their DS address.
+// ------------------------------------------------------------------------------
+static void profile_bank_name(u8 *base, char *name)
+{
+    for (u8 i=0; i<RAM_SLOTS; i++) // Expansion banks can only tell us where they are right now
+    {
+        if (ram_slot_bank[i] && (base >= ram_slot_mem[i]) && (base < ram_slot_mem[i]+0x10000))
+        {
+            sprintf(name, "XRAM %d/%d", ram_slot_bank[i], (int)((base - ram_slot_mem[i]) >> 14));
+            return;
+        }
+    }
+
+    for (u8 i=0; (amstrad_mode == MODE_CPR) && (i<32); i++) // The cart banks sit inside ROM_Memory[]
+    {
+        if (base == CartBankPtr[i])
+        {
+            sprintf(name, "CART %d", i);
+            return;
+        }
+    }
+
+    if      (base == OS_6128)                                   strcpy(name, "OS");
+    else if (base == BASIC_6128)                                strcpy(name, "BASIC");
+    else if (base == AMSDOS)                                    strcpy(name, "AMSDOS");
+    else if (base == PARADOS)                                   strcpy(name, "PARADOS");
+    else if (base == SLOT6_ROM)                                 strcpy(name, "SLOT6");
+    else if ((base >= RAM_Memory) && (base < RAM_Memory+sizeof(RAM_Memory)))
+        sprintf(name, "RAM %d", (int)((base - RAM_Memory) >> 14));
+    else if ((base >= ROM_Memory) && (base < ROM_Memory+sizeof(ROM_Memory)))
+        sprintf(name, "ROM %d", (int)((base - ROM_Memory) >> 14));
+    else                                                        strcpy(name, "OTHER");
+}
+
+// ------------------------------------------------------------------------------
+// Write out what the Z80 profiler has gathered since the last reset. The file
+// is named after the game CRC so several profiles can sit side by side and is
+// meant to be fed to tools/profile_report.c on the PC. The opcode bytes are
+// taken from the memory map as it is right now - good enough to disassemble.
+// ------------------------------------------------------------------------------
+void profile_save(void)
+{
+    char filename[32];
+    char name[16];
+
+    sprintf(filename, "/data/profile_%08lX.txt", file_crc);
+    FILE *fp = fopen(filename, "w");
+    if (fp)
+    {
+        fprintf(fp, "# SugarDS Z80 profile CRC=%08lX T=%lu IDLE=%lu\n", file_crc, CPU.TStates, IdleSkipped);
+        for (int b=0; b<PROFILE_BANKS; b++)
+        {
+            if (ProfileBankCycles[b] == 0) continue;
+            profile_bank_name(ProfileBankBase[b], name);
+            fprintf(fp, "BANK %-8s %lu\n", name, ProfileBankCycles[b]);
+        }
+        for (u32 pc=0; pc<0x10000; pc++)
+        {
+            if (ProfileCount[pc] == 0) continue;
+            fprintf(fp, "%04lX %lu %lu", pc, ProfileCount[pc], ProfileCycles[pc]);
+            for (u32 i=0; i<4; i++) fprintf(fp, " %02X", MemoryMapR[((pc+i)&0xFFFF)>>14][(pc+i)&0xFFFF]);
+            fprintf(fp, "\n");
+        }
+        fclose(fp);
+    }
 }
+#endif
 
 // End of file
@@ -0,0 +1,120 @@
+// =====================================================================================
+// Copyright (c) 2025 Dave Bernazzani (wavemotion-dave)
+//
+// Copying and distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted in any medium without
+// royalty provided this copyright notice is used and wavemotion-dave and Marat
+// Fayzullin (ColEM core) are thanked profusely.
+//
+// The SugarDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+#include <nds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SugarDS.h"
+#include "AmsUtils.h"
+#include "arena.h"
+
+extern int getMemFree(void);
+
+// ------------------------------------------------------------------------------------
+// Where all of our big memory goes. The static buffers are fixed at build time but
+// we track how much of each a game really uses so the debugger can show the budget.
+// ------------------------------------------------------------------------------------
+arena_region_t arena[ARENA_REGIONS] =
+{
+    {"RAM",  0, 0, 0, 0, LIFE_RUN},
+    {"ROM",  0, 0, 0, 0, LIFE_LOAD | LIFE_RUN},     // Dandanator carts run straight from here
+    {"DISK", 0, 0, 0, 0, LIFE_RUN},
+    {"CART", 0, 0, 0, 0, LIFE_RUN},
+    {"SCR",  0, 0, 0, 0, LIFE_SAVE},                // Save states
+    {"XRAM", 0, 0, 0, 0, LIFE_RUN},
+    {"VRAM", 0, 0, 0, 0, LIFE_RUN},
+};
+
+int arena_boot_free = 0;            // Free heap once the emulator has started up
+
+static u8 *scratch_heap = 0;        // Only if we couldn't borrow from the disk buffer
+
+void arena_init(void)
+{
+    arena[ARENA_RAM].base  = RAM_Memory;
+    arena[ARENA_RAM].size  = sizeof(RAM_Memory);
+    arena[ARENA_ROM].base  = ROM_Memory;
+    arena[ARENA_ROM].size  = sizeof(ROM_Memory);
+    arena[ARENA_DISK].base = ROM_Memory;
+    arena[ARENA_CART].base = ROM_Memory;
+    arena[ARENA_VRAM].base = (u8*)0x06820000;   // Banks B and D-I (see useVRAM())
+    arena[ARENA_VRAM].size = (128+128+64+16+16+32+16) * 1024;
+
+    arena_use(ARENA_RAM,  arena[ARENA_RAM].size);
+    arena_use(ARENA_VRAM, arena[ARENA_VRAM].size);
+
+    arena_boot_free = getMemFree();
+}
+
+void arena_use(u8 region, u32 bytes)
+{
+    arena[region].used = bytes;
+    if (bytes > arena[region].peak) arena[region].peak = bytes;
+}
+
+// ------------------------------------------------------------------------------------
+// Borrow some scratch memory until arena_scratch_done(). Whatever part of ROM_Memory[]
+// isn't holding the loaded file (and any padded cart banks) is idle so we take it from
+// there and only fall back to the heap for very large files. Only one borrower at a
+// time - the save and load state never nest. Returns NULL if the heap can't spare it
+// either - arena_scratch_done() is still fine to call.
+// ------------------------------------------------------------------------------------
+u8 *arena_scratch(u32 bytes)
+{
+    u32 busy = arena[ARENA_ROM].used + arena[ARENA_CART].used;
+    busy = (busy + 31) & ~31;
+
+    if ((busy + bytes) <= ROM_TAIL_START)
+    {
+        arena_use(ARENA_SCRATCH, bytes);
+        return ROM_Memory + busy;
+    }
+
+    scratch_heap = malloc(bytes);
+    if (scratch_heap) arena_use(ARENA_SCRATCH, bytes);
+    return scratch_heap;
+}
+
+void arena_scratch_done(void)
+{
+    if (scratch_heap) free(scratch_heap);
+    scratch_heap = 0;
+    arena_use(ARENA_SCRATCH, 0);
+}
+
+// ------------------------------------------------------------------------------------
+// One line of the memory budget for the debugger - size and peak use in K for each
+// region and then the free heap at startup and now. Lines past the end are blank.
+// ------------------------------------------------------------------------------------
+void arena_report_line(u8 line, char *str)
+{
+    if (line == 0)
+    {
+        strcpy(str, "MEM  SIZE  PEAK");
+    }
+    else if (line <= ARENA_REGIONS)
+    {
+        arena_region_t *r = &arena[line-1];
+        sprintf(str, "%-4s %4ldK %4ldK", r->name, (long)(r->size / 1024), (long)(r->peak / 1024));
+    }
+    else if (line == ARENA_REGIONS+1)
+    {
+        sprintf(str, "HEAP %4dK %4dK", arena_boot_free / 1024, getMemFree() / 1024);
+    }
+    else
+    {
+        strcpy(str, "                ");
+    }
+}
+
+// End of file
@@ -0,0 +1,64 @@
+// =====================================================================================
+// Copyright (c) 2025 Dave Bernazzani (wavemotion-dave)
+//
+// Copying and distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted in any medium without
+// royalty provided this copyright notice is used and wavemotion-dave and Marat
+// Fayzullin (ColEM core) are thanked profusely.
+//
+// The SugarDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <nds.h>
+
+// ---------------------------------------------------------------------------------
+// The big emulator buffers as named regions of one memory budget. Each has a
+// lifetime - when its contents matter - so phases that never overlap can share:
+// the disk image and cart banks are used right where the file was loaded into
+// ROM_Memory[] and the compression scratch is borrowed from the unused tail.
+// ---------------------------------------------------------------------------------
+#define ARENA_RAM           0       // RAM_Memory[] - the CPC's own 128K
+#define ARENA_ROM           1       // ROM_Memory[] - the game file as read from SD
+#define ARENA_DISK          2       // The inserted disk image - in place in ROM_Memory[]
+#define ARENA_CART          3       // .CPR cart banks - in place, plus any padded short banks
+#define ARENA_SCRATCH       4       // Compression scratch - borrowed, never owned
+#define ARENA_XRAM          5       // Expansion RAM banks - resident slots and packed
+#define ARENA_VRAM          6       // The VRAM banks claimed by useVRAM()
+#define ARENA_REGIONS       7
+
+#define LIFE_LOAD           0x01    // Only needed while a game is loading
+#define LIFE_RUN            0x02    // Needed while the emulation runs
+#define LIFE_SAVE           0x04    // Only needed to save or load a state
+
+// -------------------------------------------------------------------------------
+// The last two 64K slots of ROM_Memory[] are held back for expansion RAM on
+// the DS-Lite/Phat in case the heap can't spare them - nothing else goes there.
+// Everything in front of them (ROM_TAIL_START bytes) is free for the loaded file:
+// an 896K disk image plus its header.
+// -------------------------------------------------------------------------------
+#define ROM_TAIL_SLOTS      2
+#define ROM_TAIL_RESERVE    (ROM_TAIL_SLOTS * 0x10000)
+#define ROM_TAIL_START      (MAX_ROM_SIZE + DSK_HEADER_SIZE - ROM_TAIL_RESERVE)
+
+typedef struct
+{
+    const char *name;
+    u8  *base;
+    u32  size;                      // Bytes reserved (zero if it comes and goes)
+    u32  used;                      // Bytes in use right now
+    u32  peak;                      // Most ever in use
+    u8   life;
+} arena_region_t;
+
+extern arena_region_t arena[ARENA_REGIONS];
+extern int arena_boot_free;
+
+extern void arena_init(void);
+extern void arena_use(u8 region, u32 bytes);
+extern u8  *arena_scratch(u32 bytes);
+extern void arena_scratch_done(void);
+extern void arena_report_line(u8 line, char *str);
+
+#endif // _ARENA_H_
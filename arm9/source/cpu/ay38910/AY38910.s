@@ -5,7 +5,7 @@
 ;@  Created by Fredrik Ahlström on 2006-03-07.
 ;@  Copyright © 2006-2024 Fredrik Ahlström. All rights reserved.
 ;@
-#ifdef __arm__
+#if defined(__arm__) && !defined(AY_PORTABLE_C)
 
 #include "AY38910.i"
 
@@ -402,4 +402,4 @@ volLoop:
 
 ;@----------------------------------------------------------------------------
 	.end
-#endif // #ifdef __arm__
+#endif // #if defined(__arm__) && !defined(AY_PORTABLE_C)
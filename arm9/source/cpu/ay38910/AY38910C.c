@@ -0,0 +1,246 @@
+//
+//  AY38910C.c
+//  AY-3-8910 / YM2149 sound chip emulator - portable C version of AY38910.s.
+//
+//  Created by Fredrik Ahlström on 2006-03-07.
+//  Copyright © 2006-2024 Fredrik Ahlström. All rights reserved.
+//
+//  The C port follows the assembly step for step - the same packed counters,
+//  the same envelope stepping and the same filter - so that it produces the
+//  very same samples and leaves the chip struct in the very same state. It is
+//  what gets built anywhere that isn't ARM (e.g. to run, time or check the
+//  sound on a PC) and it can be used on the DS instead of the assembly by
+//  adding -DAY_PORTABLE_C to both CFLAGS and ASFLAGS. (It can't be named
+//  AY38910.c as both would build to AY38910.o.)
+//
+#if !defined(__arm__) || defined(AY_PORTABLE_C)
+
+#include <string.h>
+
+#include "AY38910Int.h"
+
+#ifdef AY_UPSHIFT
+#define USHIFT  AY_UPSHIFT
+#else
+#define USHIFT  0
+#endif
+#ifdef AYFILTER
+#define FSHIFT  (AYFILTER+USHIFT)
+#else
+#define FSHIFT  (1+USHIFT)
+#endif
+
+static u32 attenuation[32] =    // each step * 0.70710678 (-3dB?)
+{
+    0x0000, 0x00AB, 0x00F1, 0x0155, 0x01E3, 0x02AB, 0x03C5, 0x0555,
+    0x078B, 0x0AAB, 0x0F16, 0x1555, 0x1E2B, 0x2AAB, 0x3C57, 0x5555,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+static const u8 regMask[16] =
+{
+    0xFF,0x0F,0xFF,0x0F,0xFF,0x0F,0x1F,0xFF, 0x1F,0x1F,0x1F,0xFF,0xFF,0x0F,0xFF,0xFF
+};
+
+typedef void (*ay_out_fn)(u8 value);
+typedef u8   (*ay_in_fn)(u8 value, u8 inout);
+
+void ay38910Mixer(int count, s16 *dest, AY38910 *chip)
+{
+    u32 tone0 = chip->ch0Freq | (chip->ch0Addr << 16);
+    u32 tone1 = chip->ch1Freq | (chip->ch1Addr << 16);
+    u32 tone2 = chip->ch2Freq | (chip->ch2Addr << 16);
+    u32 noise = chip->ch3Freq | (chip->ch3Addr << 16);
+    u32 rng   = chip->ayRng;
+    u32 env   = chip->ayEnvFreq;
+    u32 state = getState(chip);
+    u32 mix   = chip->ayOldSample;
+    const u32 *att = (const u32 *)chip->ayEnvVolumePtr;
+
+    if (chip->ayAttChg) calculateVolumes(chip, &state, att);
+
+    u32 len = (u32)count << USHIFT;
+    while (len)
+    {
+        mix -= mix >> (FSHIFT-USHIFT);
+        do
+        {
+            tone0 += AYTONEADD;
+            if (tone0 < AYTONEADD) {tone0 -= tone0 << 20; state ^= 0x01;}   // Channel A
+            tone1 += AYTONEADD;
+            if (tone1 < AYTONEADD) {tone1 -= tone1 << 20; state ^= 0x02;}   // Channel B
+            tone2 += AYTONEADD;
+            if (tone2 < AYTONEADD) {tone2 -= tone2 << 20; state ^= 0x04;}   // Channel C
+
+            noise += AYNOISEADD;
+            if (noise < AYNOISEADD)
+            {
+                noise -= noise << 27;
+                state |= 0x38;
+                if (rng & 1) {rng = (rng >> 1) ^ WFEED; state ^= 0x38;}    // Noise channel
+                else rng >>= 1;
+            }
+
+            env += AYENVADD;
+            if (env < AYENVADD) {env -= env << 16; state += 0x08000000;}
+            if (state & (state << 15) & 0x80000000) state &= ~0x78000000;  // Envelope Hold
+
+            u32 out = state | (state >> 10);    // Channels disable
+            out &= out >> 3;                    // Noise disable
+            out <<= 29;
+            mix += (u16)chip->ayCalculatedVolumes[out >> 29];
+
+            // Envelope Attack (with Alternate already flipped from Hold) picks the direction
+            u32 step = state & 0x78000000;
+            if (!(((state & (state << 14)) ^ (state << 13)) & 0x80000000)) step ^= 0x78000000;
+
+            out &= state << 22;                 // Check if any channels use envelope
+            if (out)
+            {
+                u32 vol = att[step >> 27];
+                if (out & 0x80000000) mix += vol;
+                if (out & 0x40000000) mix += vol;
+                if (out & 0x20000000) mix += vol;
+            }
+        } while (--len & ((1 << USHIFT) - 1));
+
+        *dest++ = (s16)((mix >> FSHIFT) ^ 0x8000);
+    }
+
+    chip->ch0Freq = tone0; chip->ch0Addr = tone0 >> 16;
+    chip->ch1Freq = tone1; chip->ch1Addr = tone1 >> 16;
+    chip->ch2Freq = tone2; chip->ch2Addr = tone2 >> 16;
+    chip->ch3Freq = noise; chip->ch3Addr = noise >> 16;
+    chip->ayRng = rng;
+    chip->ayEnvFreq = env;
+    setState(chip, state);
+    chip->ayOldSample = mix;
+}
+
+static void updateAllRegisters(AY38910 *chip)
+{
+    for (u8 i=0; i<0x10; i++)
+    {
+        ay38910IndexW(i, chip);
+        ay38910DataW(chip->ayRegs[i], chip);
+    }
+}
+
+void ay38910Reset(AY38910 *chip)
+{
+    memset(chip, 0x00, sizeof(AY38910));
+
+    updateAllRegisters(chip);
+
+    chip->ayEnvVolumePtr = (u16 *)attenuation;
+    chip->ayPortAIn = 0xFF;     // No in/out functions until the caller sets them
+    chip->ayPortBIn = 0xFF;
+    chip->ayRng = NSEED;
+}
+
+int ay38910SaveState(void *dest, const AY38910 *chip)
+{
+    memcpy(dest, chip->ayRegs, 0x10);
+    return 0x10;
+}
+
+int ay38910LoadState(AY38910 *chip, const void *source)
+{
+    memcpy(chip->ayRegs, source, 0x10);
+    updateAllRegisters(chip);
+    return 0x10;
+}
+
+int ay38910GetStateSize(void)
+{
+    return 0x10;
+}
+
+void ay38910IndexW(u8 index, AY38910 *chip)
+{
+    if ((index & 0xF0) == 0) chip->ayRegIndex = index;
+}
+
+void ay38910DataW(u8 value, AY38910 *chip)
+{
+    u8 reg = chip->ayRegIndex;
+    u16 freq;
+
+    value &= regMask[reg];
+    chip->ayRegs[reg] = value;
+
+    switch (reg)
+    {
+        case 0x0: case 0x1:     // Frequency fine / coarse
+        case 0x2: case 0x3:
+        case 0x4: case 0x5:
+            reg &= ~1;
+            freq = chip->ayRegs[reg] | (chip->ayRegs[reg+1] << 8);
+            if (freq == 0) freq = 1;
+            if (reg == 0)      chip->ch0Freq = freq;
+            else if (reg == 2) chip->ch1Freq = freq;
+            else               chip->ch2Freq = freq;
+            break;
+
+        case 0x6:               // Frequency coarse noise
+            chip->ch3Freq = value ? value : 1;
+            break;
+
+        case 0x7:               // Channel disable - save top envelope enable bits
+            chip->ayChDisable = (chip->ayChDisable & 3) | (value << 2);
+            break;
+
+        case 0x8:               // Attenuation
+        case 0x9:
+        case 0xA:
+            chip->ayAttChg = reg;
+            break;
+
+        case 0xB:               // Envelope frequency
+        case 0xC:
+            freq = chip->ayRegs[0xB] | (chip->ayRegs[0xC] << 8);
+            if (freq == 0) freq = 1;
+            chip->ayEnvFreq = (chip->ayEnvFreq & 0xFFFF0000) | freq;
+            break;
+
+        case 0xD:               // Envelope type
+            if (value < 4) value = 9;
+            else if (value < 8) value = 0xF;
+            if (value & 1) value ^= 2;  // ALT ^= Hold
+            chip->ayEnvType = value;
+            chip->ayEnvAddr = 0;        // Also clear Envelope addr
+            break;
+
+        case 0xE:
+            chip->ayPortAOut = value;
+            if ((chip->ayRegs[7] & 0x40) && chip->ayPortAOutFptr) ((ay_out_fn)chip->ayPortAOutFptr)(value);
+            break;
+
+        case 0xF:
+            chip->ayPortBOut = value;
+            if ((chip->ayRegs[7] & 0x80) && chip->ayPortBOutFptr) ((ay_out_fn)chip->ayPortBOutFptr)(value);
+            break;
+    }
+}
+
+u8 ay38910DataR(AY38910 *chip)
+{
+    u8 reg = chip->ayRegIndex;
+    u8 inout;
+
+    if (reg < 0xE) return chip->ayRegs[reg];
+
+    if (reg == 0xE)
+    {
+        inout = chip->ayRegs[7] & 0x40;
+        if (chip->ayPortAInFptr) return ((ay_in_fn)chip->ayPortAInFptr)(inout ? chip->ayPortAOut : 0, inout);
+        return chip->ayPortAIn;
+    }
+
+    inout = chip->ayRegs[7] & 0x80;
+    if (chip->ayPortBInFptr) return ((ay_in_fn)chip->ayPortBInFptr)(inout ? chip->ayPortBOut : 0, inout);
+    return chip->ayPortBIn;
+}
+
+#endif // !__arm__ || AY_PORTABLE_C
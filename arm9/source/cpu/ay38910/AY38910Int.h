@@ -0,0 +1,84 @@
+//
+//  AY38910Int.h
+//  AY-3-8910 / YM2149 sound chip emulator - the chip internals shared by the
+//  C mixers (AY38910C.c and the band-limited AYBlip.c) and the sound worker.
+//
+//  Created by Fredrik Ahlström on 2006-03-07.
+//  Copyright © 2006-2024 Fredrik Ahlström. All rights reserved.
+//
+
+#ifndef AY38910INT_HEADER
+#define AY38910INT_HEADER
+
+#if defined(ARM9) || defined(ARM7)
+#include <nds.h>
+#else
+#include <stdint.h>
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+#endif
+
+#include "AY38910.h"
+
+#define NSEED   0x10000         // Noise Seed
+#define WFEED   0x12000         // White Noise Feedback, according to MAME.
+
+// The counters count up in the top bits of each packed freq/addr word
+#define AYNOISEADD 0x08000000
+#define AYTONEADD  0x00100000
+#define AYENVADD   0x00010000
+
+// ----------------------------------------------------------------------------
+// The channel state word - the four bytes from ayChState to ayEnvAddr:
+//  bits 0-2    Tone output of channels A, B, C
+//  bits 3-5    Noise output (the same for all three)
+//  bits 7-9    Channel A, B, C volume comes from the envelope
+//  bits 10-15  Register 7 - tone and noise disable for A, B, C
+//  bits 16-23  Envelope type (with Alternate already flipped by Hold)
+//  bits 27-31  Envelope step - bit 31 set once the first 16 steps are done
+// ----------------------------------------------------------------------------
+static inline u32 getState(const AY38910 *chip)
+{
+    return chip->ayChState | (chip->ayChDisable << 8) | (chip->ayEnvType << 16) | ((u32)chip->ayEnvAddr << 24);
+}
+
+static inline void setState(AY38910 *chip, u32 state)
+{
+    chip->ayChState   = state;
+    chip->ayChDisable = state >> 8;
+    chip->ayEnvType   = state >> 16;
+    chip->ayEnvAddr   = state >> 24;
+}
+
+// ----------------------------------------------------------------------------
+// Work out the fixed volume for each of the 8 combinations of channels high
+// and note which channels take their volume from the envelope instead.
+// ----------------------------------------------------------------------------
+static inline void calculateVolumes(AY38910 *chip, u32 *state, const u32 *att)
+{
+    u32 vol[3];
+
+    *state &= ~0x0380;
+    for (int ch=0; ch<3; ch++)
+    {
+        u8 reg = chip->ayRegs[8+ch] & 0x1F;
+        vol[ch] = reg ? att[reg] : 0;
+        if (reg & 0x10) *state |= (0x0080 << ch);
+    }
+
+    for (int i=7; i>0; i--)
+    {
+        u32 sum = 0;
+        if (i & 1) sum += vol[0];
+        if (i & 4) sum += vol[2];
+        if (i & 2) sum += vol[1];
+        chip->ayCalculatedVolumes[i] = (s16)sum;
+    }
+    chip->ayAttChg = 0;
+}
+
+#endif // AY38910INT_HEADER
@@ -0,0 +1,219 @@
+//
+//  AYBlip.c
+//  Band-limited output for the AY-3-8910 / YM2149 sound chip emulator. It runs
+//  the very same chip state as AY38910.s and AY38910C.c by Fredrik Ahlström.
+//
+//  ay38910Mixer point samples the chip - each output sample is the average of
+//  the 1 << AY_UPSHIFT ticks it covers - so every square wave edge lands on a
+//  sample boundary and anything above half the sample rate folds back down as
+//  aliasing. That is why it wants a high sample rate. Here the chip is run tick
+//  by tick just the same but each change of the output level goes in as a
+//  band-limited step (a windowed sinc, integrated) at the exact time of its
+//  tick, in the manner of a BLEP/BLIP buffer. Only the changes cost anything
+//  and the output can be made at a much lower rate (e.g. 22050Hz) cleanly.
+//
+#include "AY38910Int.h"
+#include "AYBlip.h"
+
+#define BLIP_BITS       14      // Each step kernel sums to 1 << BLIP_BITS
+#define BLIP_CUTOFF     0.38    // As a fraction of the sample rate - the kernel's roll off ends at Nyquist
+#define BLIP_DC_SHIFT   10      // DC removal time constant - 1024 samples (46ms at 22050Hz)
+
+static s16 blipKernel[AYBLIP_PHASES][AYBLIP_TAPS];
+static u8 blipKernelReady = 0;
+
+// A sine good to better than 1e-6 - all we need to build the kernel (no libm)
+static double blipSin(double x)
+{
+    const double pi = 3.14159265358979323846;
+    while (x > pi)  x -= 2*pi;
+    while (x < -pi) x += 2*pi;
+
+    double x2 = x*x, term = x, sum = x;
+    for (int n=3; n<=17; n+=2)
+    {
+        term *= -x2 / ((n-1)*n);
+        sum += term;
+    }
+    return sum;
+}
+
+// -----------------------------------------------------------------------------
+// The band-limited impulse for a step a fraction of the way into a sample - a
+// Blackman windowed sinc centred on tap 7 plus that fraction. Each phase is
+// made to sum to exactly 1 << BLIP_BITS so a step always lands on the level.
+// -----------------------------------------------------------------------------
+static void blipMakeKernel(void)
+{
+    const double pi = 3.14159265358979323846;
+    const double half = AYBLIP_TAPS / 2;
+
+    for (int p=0; p<AYBLIP_PHASES; p++)
+    {
+        double h[AYBLIP_TAPS], total = 0;
+        for (int t=0; t<AYBLIP_TAPS; t++)
+        {
+            double x = t - (half - 1) - (double)p / AYBLIP_PHASES;
+            double y = 2 * BLIP_CUTOFF * x;
+            double sinc = (y == 0) ? 1 : blipSin(pi * y) / (pi * y);
+            double w = 0.42 + 0.5 * blipSin(pi * x / half + pi/2) + 0.08 * blipSin(2 * pi * x / half + pi/2);
+            h[t] = 2 * BLIP_CUTOFF * sinc * ((x > -half) ? w : 0);
+            total += h[t];
+        }
+
+        int sum = 0, peak = 0;
+        for (int t=0; t<AYBLIP_TAPS; t++)
+        {
+            double v = h[t] * (1 << BLIP_BITS) / total;
+            blipKernel[p][t] = (s16)(v < 0 ? v - 0.5 : v + 0.5);
+            sum += blipKernel[p][t];
+            if (blipKernel[p][t] > blipKernel[p][peak]) peak = t;
+        }
+        blipKernel[p][peak] += (1 << BLIP_BITS) - sum;
+    }
+    blipKernelReady = 1;
+}
+
+void ayBlipInit(AYBlip *blip, u32 tickRate, u32 sampleRate)
+{
+    if (!blipKernelReady) blipMakeKernel();
+
+    for (int i=0; i<AYBLIP_CHUNK + AYBLIP_TAPS; i++) blip->buffer[i] = 0;
+    blip->tickStep = (u32)(((unsigned long long)sampleRate << 16) / tickRate);
+    blip->tickPos  = 0;
+    blip->level    = 0;
+    blip->sum      = 0;
+    blip->dc       = 0;
+}
+
+void ayBlipMixer(int count, s16 *dest, AY38910 *chip, AYBlip *blip)
+{
+    u32 tone0 = chip->ch0Freq | (chip->ch0Addr << 16);
+    u32 tone1 = chip->ch1Freq | (chip->ch1Addr << 16);
+    u32 tone2 = chip->ch2Freq | (chip->ch2Addr << 16);
+    u32 noise = chip->ch3Freq | (chip->ch3Addr << 16);
+    u32 rng   = chip->ayRng;
+    u32 env   = chip->ayEnvFreq;
+    u32 state = getState(chip);
+    const u32 *att = (const u32 *)chip->ayEnvVolumePtr;
+    s32 *buffer = blip->buffer;
+    s32 level = blip->level;
+    s32 sum = blip->sum;
+    s32 dc = blip->dc;
+    u32 pos = blip->tickPos;
+    u8 fresh = 1;
+
+    if (chip->ayAttChg) calculateVolumes(chip, &state, att);
+
+    while (count > 0)
+    {
+        int len = (count > AYBLIP_CHUNK) ? AYBLIP_CHUNK : count;
+        u32 end = (u32)len << 16;
+
+        for (; pos < end; pos += blip->tickStep)
+        {
+            // Nothing can change until one of the counters wraps so skip straight to the
+            // tick where the first one does (or the last tick of the chunk). Not on the
+            // first tick though - register writes since the last call show up there.
+            u32 skip = fresh ? 1 : 0x1000 - (tone0 >> 20);
+            u32 n = 0x1000 - (tone1 >> 20); if (n < skip) skip = n;
+            n = 0x1000 - (tone2 >> 20);     if (n < skip) skip = n;
+            n = 0x20 - (noise >> 27);       if (n < skip) skip = n;
+            n = 0x10000 - (env >> 16);      if (n < skip) skip = n;
+            fresh = 0;
+            if (--skip)
+            {
+                if (pos + skip * blip->tickStep >= end) skip = (end - 1 - pos) / blip->tickStep;
+                tone0 += skip * AYTONEADD;
+                tone1 += skip * AYTONEADD;
+                tone2 += skip * AYTONEADD;
+                noise += skip * AYNOISEADD;
+                env   += skip * AYENVADD;
+                pos   += skip * blip->tickStep;
+            }
+
+            // One chip tick - exactly as ay38910Mixer runs it
+            tone0 += AYTONEADD;
+            if (tone0 < AYTONEADD) {tone0 -= tone0 << 20; state ^= 0x01;}   // Channel A
+            tone1 += AYTONEADD;
+            if (tone1 < AYTONEADD) {tone1 -= tone1 << 20; state ^= 0x02;}   // Channel B
+            tone2 += AYTONEADD;
+            if (tone2 < AYTONEADD) {tone2 -= tone2 << 20; state ^= 0x04;}   // Channel C
+
+            noise += AYNOISEADD;
+            if (noise < AYNOISEADD)
+            {
+                noise -= noise << 27;
+                state |= 0x38;
+                if (rng & 1) {rng = (rng >> 1) ^ WFEED; state ^= 0x38;}    // Noise channel
+                else rng >>= 1;
+            }
+
+            env += AYENVADD;
+            if (env < AYENVADD) {env -= env << 16; state += 0x08000000;}
+            if (state & (state << 15) & 0x80000000) state &= ~0x78000000;  // Envelope Hold
+
+            u32 out = state | (state >> 10);    // Channels disable
+            out &= out >> 3;                    // Noise disable
+            out <<= 29;
+            s32 now = (u16)chip->ayCalculatedVolumes[out >> 29];
+
+            // Envelope Attack (with Alternate already flipped from Hold) picks the direction
+            u32 step = state & 0x78000000;
+            if (!(((state & (state << 14)) ^ (state << 13)) & 0x80000000)) step ^= 0x78000000;
+
+            out &= state << 22;                 // Check if any channels use envelope
+            if (out)
+            {
+                s32 vol = att[step >> 27];
+                if (out & 0x80000000) now += vol;
+                if (out & 0x40000000) now += vol;
+                if (out & 0x20000000) now += vol;
+            }
+
+            // Only a change of level makes any work - a band-limited step at this tick
+            if (now != level)
+            {
+                s32 delta = now - level;
+                const s16 *k = blipKernel[(pos >> (16 - AYBLIP_PHASE_BITS)) & (AYBLIP_PHASES - 1)];
+                s32 *b = &buffer[pos >> 16];
+                for (int t=0; t<AYBLIP_TAPS; t++) b[t] += delta * k[t];
+                level = now;
+            }
+        }
+        pos -= end;
+
+        // The buffer holds the steps' slopes - sum them up for the output. The chip only
+        // ever puts out positive levels so we take the DC off and centre it on zero -
+        // otherwise the steps' ringing would clip every time a channel goes quiet.
+        for (int i=0; i<len; i++)
+        {
+            sum += buffer[i];
+            s32 now = sum >> BLIP_BITS;
+            dc += ((now << 8) - dc) >> BLIP_DC_SHIFT;
+            s32 sample = now - (dc >> 8);
+            if (sample > 0x7FFF) sample = 0x7FFF;
+            if (sample < -0x8000) sample = -0x8000;
+            *dest++ = (s16)sample;
+        }
+
+        // And move the tails of the steps that run past this chunk up to the front
+        for (int i=0; i<AYBLIP_TAPS; i++) buffer[i] = buffer[len + i];
+        for (int i=AYBLIP_TAPS; i<len + AYBLIP_TAPS; i++) buffer[i] = 0;
+
+        count -= len;
+    }
+
+    chip->ch0Freq = tone0; chip->ch0Addr = tone0 >> 16;
+    chip->ch1Freq = tone1; chip->ch1Addr = tone1 >> 16;
+    chip->ch2Freq = tone2; chip->ch2Addr = tone2 >> 16;
+    chip->ch3Freq = noise; chip->ch3Addr = noise >> 16;
+    chip->ayRng = rng;
+    chip->ayEnvFreq = env;
+    setState(chip, state);
+
+    blip->level = level;
+    blip->sum = sum;
+    blip->dc = dc;
+    blip->tickPos = pos;
+}
@@ -0,0 +1,52 @@
+//
+//  AYBlip.h
+//  Band-limited output for the AY-3-8910 / YM2149 sound chip emulator. It runs
+//  the very same chip state as AY38910.s and AY38910C.c by Fredrik Ahlström.
+//
+
+#ifndef AYBLIP_HEADER
+#define AYBLIP_HEADER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AYBLIP_PHASE_BITS 7
+#define AYBLIP_PHASES     (1 << AYBLIP_PHASE_BITS)  // Steps are placed to 1/128 of an output sample
+#define AYBLIP_TAPS       16      // Length of each band-limited step (output samples)
+#define AYBLIP_CHUNK      256     // Output samples worked on at a time
+
+typedef struct {
+	u32 tickStep;               // Output samples per chip tick (16.16)
+	u32 tickPos;                // Where the next chip tick falls in the chunk (16.16)
+	s32 level;                  // The chip output level the steps have reached
+	s32 sum;                    // Running sum of the buffer - the output level (scaled)
+	s32 dc;                     // The level's slow average (x256) - taken off the output
+	s32 buffer[AYBLIP_CHUNK + AYBLIP_TAPS];
+} AYBlip;
+
+/**
+ * Set up band-limited output from the chip.
+ * @param  *blip: The band-limited output state.
+ * @param  tickRate: Chip ticks (tone counter clocks, the chip clock / 8) per second.
+ * @param  sampleRate: Output samples per second.
+ */
+void ayBlipInit(AYBlip *blip, u32 tickRate, u32 sampleRate);
+
+/**
+ * Run the chip and produce band-limited output. Each time the chip output
+ * changes a band-limited step is put in at the exact tick it happened, so
+ * the sound can be made at a low sample rate without aliasing. The chip
+ * is left in the same state as if ay38910Mixer had run it for as long.
+ * @param  count: Number of samples to produce.
+ * @param  *dest: Where to put the samples (signed 16bit mono).
+ * @param  *chip: The AY38910 chip.
+ * @param  *blip: The band-limited output state.
+ */
+void ayBlipMixer(int count, s16 *dest, AY38910 *chip, AYBlip *blip);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // AYBLIP_HEADER
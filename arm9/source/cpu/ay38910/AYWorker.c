@@ -0,0 +1,329 @@
+//
+//  AYWorker.c
+//  A sound worker for the AY-3-8910 / YM2149 sound chip emulator - see AYWorker.h.
+//
+//  The queue and the ring each have one writer per index so neither needs a
+//  lock: a side fills in its entries (or samples) and only then moves its own
+//  index on. The worker renders with ay38910Mixer (AY38910.s or AY38910C.c)
+//  and resamples to the output rate as it goes into the ring. The rate is
+//  trimmed once a frame by up to 0.5% to keep the ring around half full.
+//
+
+#include <string.h>
+
+#include "AY38910Int.h"
+#include "AYWorker.h"
+
+#ifdef ARM9
+#define AYW_FAST    ITCM_CODE
+#else
+#define AYW_FAST
+#endif
+
+#if defined(ARM9) || defined(ARM7)
+#define AYW_BARRIER()   __asm__ volatile("" ::: "memory")  // The DS CPUs don't reorder memory accesses
+#else
+#define AYW_BARRIER()   __sync_synchronize()
+#endif
+
+#define RING_MASK       (AYWORKER_RING-1)
+
+static u16 *ownVolumes = 0;     // Our own build's volume table (the chip copy has the emulation's)
+
+void ayWorkerInit(AYWorker *worker, const AYWorkerBackend *backend, u32 timePerSample)
+{
+	memset(worker, 0, sizeof(AYWorker));
+	ay38910Reset(&worker->chip);
+	worker->timePerSample = timePerSample;
+	worker->baseStep = 0x10000;
+	worker->step = 0x10000;
+	worker->backend = backend;
+	backend->start(worker);
+}
+
+void ayWorkerStop(AYWorker *worker)
+{
+	worker->backend->stop(worker);
+}
+
+void ayWorkerSync(AYWorker *worker, const AY38910 *chip, u32 time)
+{
+	worker->backend->wait(worker);
+	if (worker->revoked) return;    // The backend gave up on it - it isn't ours to write
+
+	memcpy(&worker->chip, chip, sizeof(AY38910));
+	worker->chip.ayPortAInFptr  = 0;    // The copy is only for the sound - it has no ports
+	worker->chip.ayPortBInFptr  = 0;
+	worker->chip.ayPortAOutFptr = 0;
+	worker->chip.ayPortBOutFptr = 0;
+	worker->newChip   = 1;
+	worker->time      = time;
+	worker->integ     = 0;
+	worker->overruns  = 0;
+	worker->underruns = 0;
+	AYW_BARRIER();
+}
+
+AYW_FAST void ayWorkerPush(AYWorker *worker, u32 time, u8 reg, u8 value)
+{
+	u32 head = worker->head;
+	if ((head - worker->tail) >= AYWORKER_QUEUE)
+	{
+		worker->backend->wait(worker);
+		if (worker->revoked) return;
+	}
+
+	AYWrite *entry = &worker->queue[head & (AYWORKER_QUEUE-1)];
+	entry->time  = time;
+	entry->reg   = reg;
+	entry->value = value;
+	AYW_BARRIER();
+	worker->head = head + 1;
+}
+
+// ----------------------------------------------------------------------------
+// Render the chip from where we left off up to the given CPU time and push it
+// into the ring. A full ring drops the new samples - the chip keeps running
+// so it stays in time.
+// ----------------------------------------------------------------------------
+AYW_FAST static void synthTo(AYWorker *worker, u32 time)
+{
+	s32 ahead = (s32)(time - worker->time);
+	if (ahead < (s32)worker->timePerSample) return;
+
+	u32 samples = ahead / worker->timePerSample;
+	worker->time += samples * worker->timePerSample;
+
+	u16 rd = worker->ringRead;
+	u16 wr = worker->ringWrite;
+	u32 step = worker->step;
+	u32 pos = worker->pos;
+	s16 prev = worker->prev;
+	u8 full = 0;
+
+	while (samples)
+	{
+		u32 n = (samples > AYWORKER_CHUNK) ? AYWORKER_CHUNK : samples;
+		ay38910Mixer(n, worker->chunk, &worker->chip);
+		samples -= n;
+
+		// Resample (linear) to the output rate as we go into the ring
+		for (u32 i=0; i<n; i++)
+		{
+			s32 delta = worker->chunk[i] - prev;
+			while (pos < 0x10000)
+			{
+				u16 next = (wr + 1) & RING_MASK;
+				if (next == rd) full = 1;
+				else
+				{
+					worker->ring[wr] = prev + ((delta * (s32)(pos >> 1)) >> 15);
+					wr = next;
+				}
+				pos += step;
+			}
+			pos -= 0x10000;
+			prev = worker->chunk[i];
+		}
+	}
+
+	worker->pos = pos;
+	worker->prev = prev;
+	AYW_BARRIER();
+	worker->ringWrite = wr;
+	if (full) worker->overruns++;
+}
+
+// ----------------------------------------------------------------------------
+// Once a frame - trim the resampling ratio in proportion to how far the fill
+// has wandered from half plus a slow part that takes out the steady error.
+// ----------------------------------------------------------------------------
+static void rateControl(AYWorker *worker)
+{
+	u32 base = worker->baseStep;
+	s32 integ = worker->integ;
+	s32 trim;
+
+	worker->fill = (worker->ringWrite - worker->ringRead) & RING_MASK;
+	if (worker->primed)
+	{
+		integ += AYWORKER_HALF - (s32)worker->fill;
+		if (integ > AYWORKER_HALF*1024)  integ = AYWORKER_HALF*1024;
+		if (integ < -AYWORKER_HALF*1024) integ = -AYWORKER_HALF*1024;
+	}
+	trim = ((AYWORKER_HALF - (s32)worker->fill) * AYWORKER_TRIM_PPM) / AYWORKER_HALF;
+	trim += (s32)(((s64)integ * AYWORKER_TRIM_PPM) / (AYWORKER_HALF*1024));
+	if (trim > AYWORKER_TRIM_PPM)  trim = AYWORKER_TRIM_PPM;
+	if (trim < -AYWORKER_TRIM_PPM) trim = -AYWORKER_TRIM_PPM;
+
+	worker->integ = integ;
+	worker->trim = trim;
+	// Running low means more played samples from each rendered one - a smaller step
+	worker->step = base - (s32)(((s64)base * trim) / 1000000);
+}
+
+AYW_FAST int ayWorkerPump(AYWorker *worker)
+{
+	u32 tail = worker->tail;
+	int done = 0;
+
+	while (tail != worker->head)
+	{
+		AYW_BARRIER();
+		if (worker->newChip)
+		{
+			if (!ownVolumes)
+			{
+				AY38910 scratch;
+				ay38910Reset(&scratch);
+				ownVolumes = scratch.ayEnvVolumePtr;
+			}
+			worker->chip.ayEnvVolumePtr = ownVolumes;
+			worker->newChip = 0;
+		}
+
+		AYWrite *entry = &worker->queue[tail & (AYWORKER_QUEUE-1)];
+		synthTo(worker, entry->time);
+		if (entry->reg < 16)
+		{
+			ay38910IndexW(entry->reg, &worker->chip);
+			ay38910DataW(entry->value, &worker->chip);
+		}
+		else if (entry->reg == AYW_FRAME) rateControl(worker);
+		else if (entry->reg == AYW_REBASE) worker->time -= entry->time;
+
+		AYW_BARRIER();
+		worker->tail = ++tail;
+		done++;
+	}
+	return done;
+}
+
+AYW_FAST void ayWorkerPlay(AYWorker *worker, int count, s16 *dest)
+{
+	u16 rd = worker->ringRead;
+	u16 wr = worker->ringWrite;
+	u8 primed = worker->primed;
+	s16 last = worker->last;
+	AYW_BARRIER();
+
+	// After running dry we wait for the ring to get back to half full before playing on
+	if (!primed && (((wr - rd) & RING_MASK) >= AYWORKER_HALF)) primed = 1;
+
+	for (int i=0; i<count; i++)
+	{
+		if (primed)
+		{
+			if (rd != wr)
+			{
+				last = worker->ring[rd];
+				rd = (rd + 1) & RING_MASK;
+			}
+			else {primed = 0; worker->underruns++;}
+		}
+		*dest++ = last;     // Until primed (or if we run dry) just hold the last sample
+	}
+
+	worker->primed = primed;
+	worker->last = last;
+	AYW_BARRIER();
+	worker->ringRead = rd;
+}
+
+// ----------------------------------------------------------------------------
+// In line - the worker runs right when it is kicked.
+// ----------------------------------------------------------------------------
+static void inlineStart(AYWorker *worker) {}
+static void inlineStop(AYWorker *worker) {}
+
+static void inlinePump(AYWorker *worker)
+{
+	ayWorkerPump(worker);
+}
+
+const AYWorkerBackend ayWorkerInline = {"INLINE", inlineStart, inlineStop, inlinePump, inlinePump};
+
+#if !defined(ARM9) && !defined(ARM7)
+// ----------------------------------------------------------------------------
+// A thread of its own (host builds) - it sleeps until kicked.
+// ----------------------------------------------------------------------------
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	int kicked;
+	int running;
+} AYThread;
+
+static void *threadMain(void *arg)
+{
+	AYWorker *worker = arg;
+	AYThread *t = worker->backendData;
+
+	pthread_mutex_lock(&t->lock);
+	while (t->running)
+	{
+		if (!t->kicked)
+		{
+			pthread_cond_wait(&t->work, &t->lock);
+			continue;
+		}
+		t->kicked = 0;
+		pthread_mutex_unlock(&t->lock);
+		ayWorkerPump(worker);
+		pthread_mutex_lock(&t->lock);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+
+static void threadKick(AYWorker *worker)
+{
+	AYThread *t = worker->backendData;
+
+	pthread_mutex_lock(&t->lock);
+	t->kicked = 1;
+	pthread_cond_signal(&t->work);
+	pthread_mutex_unlock(&t->lock);
+}
+
+static void threadWait(AYWorker *worker)
+{
+	threadKick(worker);
+	while (worker->tail != worker->head) sched_yield();
+	AYW_BARRIER();
+}
+
+static void threadStart(AYWorker *worker)
+{
+	AYThread *t = calloc(1, sizeof(AYThread));
+
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->work, NULL);
+	t->running = 1;
+	worker->backendData = t;
+	pthread_create(&t->thread, NULL, threadMain, worker);
+}
+
+static void threadStop(AYWorker *worker)
+{
+	AYThread *t = worker->backendData;
+
+	pthread_mutex_lock(&t->lock);
+	t->running = 0;
+	pthread_cond_signal(&t->work);
+	pthread_mutex_unlock(&t->lock);
+	pthread_join(t->thread, NULL);
+
+	pthread_cond_destroy(&t->work);
+	pthread_mutex_destroy(&t->lock);
+	free(t);
+	worker->backendData = NULL;
+}
+
+const AYWorkerBackend ayWorkerThread = {"THREAD", threadStart, threadStop, threadKick, threadWait};
+#endif
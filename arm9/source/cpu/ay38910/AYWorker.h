@@ -0,0 +1,160 @@
+//
+//  AYWorker.h
+//  A sound worker for the AY-3-8910 / YM2149 sound chip emulator. The emulation
+//  only queues the register writes (with the CPU time they were made at) and
+//  the worker plays them into its own copy of the chip and renders the sound
+//  into a ring the sound output reads from. Where the worker runs is up to the
+//  backend - in line, on a host thread or on another CPU (the DS ARM7).
+//
+
+#ifndef AYWORKER_HEADER
+#define AYWORKER_HEADER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AYWORKER_QUEUE      256     // Writes in flight - a power of two
+#define AYWORKER_RING       4096    // Rendered samples - a power of two
+#define AYWORKER_HALF       (AYWORKER_RING/2)
+#define AYWORKER_CHUNK      32      // Chip samples rendered at a time
+#define AYWORKER_TRIM_PPM   5000    // The rate control may trim by up to +/-0.5%
+
+// Queue entries that aren't register writes (reg is 0-15 for those)
+#define AYW_FRAME           0x10    // Render up to 'time' and steer the rate (once a frame)
+#define AYW_REBASE          0x11    // Take 'time' off the clock (the CPU clock was rebased)
+
+// The DS FIFO channel and messages from the ARM9 to an ARM7 worker
+#define AYWORKER_FIFO       FIFO_USER_01
+#define AYWORKER_FIFO_KICK  1       // There is work in the queue (or the worker is wanted back)
+
+typedef struct {
+	u32 time;                   // When the write was made (CPU time)
+	u8  reg;                    // The AY register written (or AYW_FRAME/AYW_REBASE)
+	u8  value;
+	u8  padding[2];
+} AYWrite;
+
+typedef struct AYWorker AYWorker;
+
+typedef struct {
+	const char *name;
+	void (*start)(AYWorker *worker);
+	void (*stop)(AYWorker *worker);     // Returns once the worker has let go (or it set revoked and gave up)
+	void (*kick)(AYWorker *worker);     // There is new work in the queue
+	void (*wait)(AYWorker *worker);     // Returns once the queue has been played out
+} AYWorkerBackend;
+
+struct AYWorker {
+	// The queue - only the emulation writes head and only the worker writes tail
+	AYWrite queue[AYWORKER_QUEUE];
+	volatile u32 head;
+	volatile u32 tail;
+	volatile u32 baseStep;      // Rendered samples per played sample (16.16) - set by the emulation
+
+	// The worker's side
+	AY38910 chip;               // The worker's own copy of the chip
+	u32 time;                   // CPU time the sound has been rendered up to
+	u32 timePerSample;          // CPU time per chip sample
+	u32 step;                   // baseStep with the rate trim applied
+	u32 pos;                    // Resampler position between the last two chip samples (16.16)
+	s16 prev;                   // The last chip sample
+	u8  newChip;                // The chip was just copied in - its volume table is the emulation's
+	u8  padding;
+	s32 integ;                  // Fill error summed over the frames (the slow part of the trim)
+	s32 trim;                   // Current rate trim in PPM
+	u32 fill;                   // Ring fill at the last frame
+	u32 overruns;               // Frames that found the ring full
+	s16 chunk[AYWORKER_CHUNK];
+
+	// The ring - only the worker writes ringWrite and only the sound output ringRead
+	volatile u16 ringRead;
+	volatile u16 ringWrite;
+	volatile u8 primed;         // Set once the ring has filled to half and is playing
+	s16 last;                   // The last sample played
+	u32 underruns;              // Sound output calls that ran dry
+	s16 ring[AYWORKER_RING];
+
+	const AYWorkerBackend *backend;
+	void *backendData;
+
+	// Handing the worker back - the emulation sets revoked and from then on the worker's
+	// CPU must not pump it again. It sets released once it has let go and only then
+	// may the emulation touch the worker (or set it up again with ayWorkerInit).
+	volatile u8 revoked;
+	volatile u8 released;
+};
+
+/**
+ * Set up the worker and start its backend.
+ * @param  *worker: The worker.
+ * @param  *backend: Where the worker runs.
+ * @param  timePerSample: CPU time per chip sample.
+ */
+void ayWorkerInit(AYWorker *worker, const AYWorkerBackend *backend, u32 timePerSample);
+
+/**
+ * Stop the backend. The worker can then be set up again with ayWorkerInit.
+ * @param  *worker: The worker.
+ */
+void ayWorkerStop(AYWorker *worker);
+
+/**
+ * Wait for the worker to play out the queue then give it a copy of the chip
+ * and line it up with the CPU time. Does nothing once the worker is revoked.
+ * The emulation side only.
+ * @param  *worker: The worker.
+ * @param  *chip: The chip as the emulation has it.
+ * @param  time: The CPU time now.
+ */
+void ayWorkerSync(AYWorker *worker, const AY38910 *chip, u32 time);
+
+/**
+ * Queue a register write (or AYW_FRAME/AYW_REBASE). The emulation side only.
+ * If the queue is full this waits for the worker to make room - if the worker
+ * was revoked instead the write is dropped.
+ * @param  *worker: The worker.
+ */
+void ayWorkerPush(AYWorker *worker, u32 time, u8 reg, u8 value);
+
+/**
+ * Tell the backend there is new work in the queue. The emulation side only.
+ * @param  *worker: The worker.
+ */
+static inline void ayWorkerKick(AYWorker *worker) {
+	worker->backend->kick(worker);
+}
+
+/**
+ * Play out everything in the queue. The worker side only - called by the backend.
+ * @param  *worker: The worker.
+ * @return The number of queue entries played.
+ */
+int ayWorkerPump(AYWorker *worker);
+
+/**
+ * Take count samples from the ring. Once the ring runs dry the last sample is
+ * held until it has filled back up to half. The sound output side only.
+ * @param  *worker: The worker.
+ * @param  count: Samples to take.
+ * @param  *dest: Where to put them.
+ */
+void ayWorkerPlay(AYWorker *worker, int count, s16 *dest);
+
+/**
+ * The worker runs right in ayWorkerKick (and ayWorkerSync).
+ */
+extern const AYWorkerBackend ayWorkerInline;
+
+#if !defined(ARM9) && !defined(ARM7)
+/**
+ * The worker runs on its own thread (host builds).
+ */
+extern const AYWorkerBackend ayWorkerThread;
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // AYWORKER_HEADER
@@ -26,9 +26,9 @@
 // which is true about 95% of the time. If the jump is not taken, we compensate TStates.
 // ----------------------------------------------------------------------------------------
 case JR_NZ:   if(CPU.AF.B.l&Z_FLAG) {CPU.TStates-=4; CPU.PC.W++;} else { M_JR; } break;
-case JR_NC:   if(CPU.AF.B.l&C_FLAG) {CPU.TStates-=4; CPU.PC.W++;} else { M_JR; } break;
+case JR_NC:   if(CPU.AF.B.l&C_FLAG) {CPU.TStates-=4; CPU.PC.W++;} else { M_JR; M_IDLE_POLL(JR_NC); } break;
 case JR_Z:    if(CPU.AF.B.l&Z_FLAG) { M_JR; } else {CPU.TStates-=4; CPU.PC.W++;} break;
-case JR_C:    if(CPU.AF.B.l&C_FLAG) { M_JR; } else {CPU.TStates-=4; CPU.PC.W++;} break;
+case JR_C:    if(CPU.AF.B.l&C_FLAG) { M_JR; M_IDLE_POLL(JR_C); } else {CPU.TStates-=4; CPU.PC.W++;} break;
 
 case JP_NZ:   if(CPU.AF.B.l&Z_FLAG) CPU.PC.W+=2; else { M_JP; } break;
 case JP_NC:   if(CPU.AF.B.l&C_FLAG) CPU.PC.W+=2; else { M_JP; } break;
@@ -228,7 +228,7 @@ case DJNZ:
   if(--CPU.BC.B.h) { M_JR; } else {CPU.TStates-=4; CPU.PC.W++;} break;
 
 case JP:   M_JP;break;
-case JR:   M_JR;break;
+case JR:   M_JR;M_IDLE_JR;break;
 case CALL: M_CALL;break;
 case RET:  if (DAN_WaitRET) {DAN_WaitRET = 0; DAN_Config = DAN_WaitCFG; ConfigureMemory();} M_RET;break;
 case SCF:  S(C_FLAG);R(N_FLAG|H_FLAG);break;
@@ -240,6 +240,7 @@ case INA:  I=OpZ80(CPU.PC.W++);CPU.AF.B.h=InZ80(I|(CPU.AF.W&0xFF00));break;
 case HALT:
   CPU.PC.W--;
   CPU.IFF|=IFF_HALT;
+  M_IDLE_HALT;
   break;
 
 case DI:
@@ -149,10 +149,13 @@ case INI:
   break;
 
 case INIR:
-  I = InZ80(CPU.BC.W);
-  WrZ80(CPU.HL.W++,I);
-  if(--CPU.BC.B.h) { CPU.AF.B.l=N_FLAG; CPU.PC.W-=2; }   // N_FLAG is not correct here but will be corrected when loop exits below. Nothing relies on the intermediate value.
-  else            { CPU.AF.B.l=Z_FLAG|(I&0x80 ? N_FLAG:0); CPU.TStates-=4;}
+  do
+  {
+    I = InZ80(CPU.BC.W);
+    WrZ80(CPU.HL.W++,I);
+    if(--CPU.BC.B.h) { CPU.AF.B.l=N_FLAG; CPU.PC.W-=2; }   // N_FLAG is not correct here but will be corrected when loop exits below. Nothing relies on the intermediate value.
+    else            { CPU.AF.B.l=Z_FLAG|(I&0x80 ? N_FLAG:0); CPU.TStates-=4;}
+  } while (CPU.BC.B.h && RepeatED(INIR));
   break;
 
 case IND:
@@ -177,19 +180,22 @@ case OUTI:
   break;
 
 case OTIR:
-  --CPU.BC.B.h;
-  I=RdZ80(CPU.HL.W++);
-  OutZ80(CPU.BC.W,I);
-  if(CPU.BC.B.h)
+  do
   {
-    CPU.AF.B.l=N_FLAG|(CPU.HL.B.l+I>255? (C_FLAG|H_FLAG):0);  // N_FLAG is not correct here but will be corrected when loop exits below. Nothing relies on the intermediate value.
-    CPU.PC.W-=2;
-  }
-  else
-  {
-    CPU.AF.B.l=(CPU.AF.B.l & S_FLAG) | Z_FLAG | (I&0x80 ? N_FLAG:0) | (CPU.HL.B.l+I>255? (C_FLAG|H_FLAG):0);
-    CPU.TStates-=4;
-  }
+    --CPU.BC.B.h;
+    I=RdZ80(CPU.HL.W++);
+    OutZ80(CPU.BC.W,I);
+    if(CPU.BC.B.h)
+    {
+      CPU.AF.B.l=N_FLAG|(CPU.HL.B.l+I>255? (C_FLAG|H_FLAG):0);  // N_FLAG is not correct here but will be corrected when loop exits below. Nothing relies on the intermediate value.
+      CPU.PC.W-=2;
+    }
+    else
+    {
+      CPU.AF.B.l=(CPU.AF.B.l & S_FLAG) | Z_FLAG | (I&0x80 ? N_FLAG:0) | (CPU.HL.B.l+I>255? (C_FLAG|H_FLAG):0);
+      CPU.TStates-=4;
+    }
+  } while (CPU.BC.B.h && RepeatED(OTIR));
   break;
 
 case OUTD:
@@ -227,6 +233,7 @@ case LDIR:
   {
     CPU.AF.B.l=(CPU.AF.B.l&~(H_FLAG|P_FLAG))|N_FLAG;
     CPU.PC.W-=2;
+    BulkCopy(LDIR);
   }
   else
   {
@@ -248,6 +255,7 @@ case LDDR:
   {
     CPU.AF.B.l=(CPU.AF.B.l&~(H_FLAG|P_FLAG))|N_FLAG;
     CPU.PC.W-=2;
+    BulkCopy(LDDR);
   }
   else
   {
@@ -272,6 +280,7 @@ case CPIR:
   CPU.AF.B.l =
     N_FLAG|(CPU.AF.B.l&C_FLAG)|ZSTable[J.B.l]|
     ((CPU.AF.B.h^I^J.B.l)&H_FLAG)|(CPU.BC.W? P_FLAG:0);
+  if(CPU.BC.W&&J.B.l) BulkSearch();
   break;  
 
 case CPD:
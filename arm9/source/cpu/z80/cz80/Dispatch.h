@@ -0,0 +1,204 @@
+/******************************************************************************
+*  SugarDS Z80 CPU
+*
+* Note: Most of this file is from the ColEm emulator core by Marat Fayzullin
+*       but heavily modified for specific NDS use. If you want to use this
+*       code, you are advised to seek out the much more portable ColEm core
+*       and contact Marat.
+*
+******************************************************************************/
+
+/** Z80: portable Z80 emulator *******************************/
+/**                                                         **/
+/**                         Dispatch.h                      **/
+/**                                                         **/
+/** This file contains the label tables used by the         **/
+/** threaded (computed goto) opcode dispatch. Each entry is **/
+/** the handler label the matching Codes*.h case becomes    **/
+/** when Z80_THREADED is defined. Opcodes without a case    **/
+/** go to Op_Default. It is included from Z80.c.            **/
+/**                                                         **/
+/** Z80_THREADED is off by default. On the PC it is no sure **/
+/** win: 'make -C tools dispatch-bench' has it anywhere     **/
+/** from ~10% slower to ~10% faster than switch() depending **/
+/** on the compiler and machine, and it has not been timed  **/
+/** on the DS itself.                                       **/
+/**                                                         **/
+/** Keep these in step with the enums in Z80.c and with the **/
+/** case labels in the Codes*.h files.                      **/
+/*************************************************************/
+
+// Single byte opcodes - Codes.h plus the four prefix bytes
+#define Z80_LABELS_MAIN \
+  &&NOP, &&LD_BC_WORD, &&LD_xBC_A, &&INC_BC, &&INC_B, &&DEC_B, &&LD_B_BYTE, &&RLCA,                        /* 0x00 */ \
+  &&EX_AF_AF, &&ADD_HL_BC, &&LD_A_xBC, &&DEC_BC, &&INC_C, &&DEC_C, &&LD_C_BYTE, &&RRCA,                    /* 0x08 */ \
+  &&DJNZ, &&LD_DE_WORD, &&LD_xDE_A, &&INC_DE, &&INC_D, &&DEC_D, &&LD_D_BYTE, &&RLA,                        /* 0x10 */ \
+  &&JR, &&ADD_HL_DE, &&LD_A_xDE, &&DEC_DE, &&INC_E, &&DEC_E, &&LD_E_BYTE, &&RRA,                           /* 0x18 */ \
+  &&JR_NZ, &&LD_HL_WORD, &&LD_xWORD_HL, &&INC_HL, &&INC_H, &&DEC_H, &&LD_H_BYTE, &&DAA,                    /* 0x20 */ \
+  &&JR_Z, &&ADD_HL_HL, &&LD_HL_xWORD, &&DEC_HL, &&INC_L, &&DEC_L, &&LD_L_BYTE, &&CPL,                      /* 0x28 */ \
+  &&JR_NC, &&LD_SP_WORD, &&LD_xWORD_A, &&INC_SP, &&INC_xHL, &&DEC_xHL, &&LD_xHL_BYTE, &&SCF,               /* 0x30 */ \
+  &&JR_C, &&ADD_HL_SP, &&LD_A_xWORD, &&DEC_SP, &&INC_A, &&DEC_A, &&LD_A_BYTE, &&CCF,                       /* 0x38 */ \
+  &&LD_B_B, &&LD_B_C, &&LD_B_D, &&LD_B_E, &&LD_B_H, &&LD_B_L, &&LD_B_xHL, &&LD_B_A,                        /* 0x40 */ \
+  &&LD_C_B, &&LD_C_C, &&LD_C_D, &&LD_C_E, &&LD_C_H, &&LD_C_L, &&LD_C_xHL, &&LD_C_A,                        /* 0x48 */ \
+  &&LD_D_B, &&LD_D_C, &&LD_D_D, &&LD_D_E, &&LD_D_H, &&LD_D_L, &&LD_D_xHL, &&LD_D_A,                        /* 0x50 */ \
+  &&LD_E_B, &&LD_E_C, &&LD_E_D, &&LD_E_E, &&LD_E_H, &&LD_E_L, &&LD_E_xHL, &&LD_E_A,                        /* 0x58 */ \
+  &&LD_H_B, &&LD_H_C, &&LD_H_D, &&LD_H_E, &&LD_H_H, &&LD_H_L, &&LD_H_xHL, &&LD_H_A,                        /* 0x60 */ \
+  &&LD_L_B, &&LD_L_C, &&LD_L_D, &&LD_L_E, &&LD_L_H, &&LD_L_L, &&LD_L_xHL, &&LD_L_A,                        /* 0x68 */ \
+  &&LD_xHL_B, &&LD_xHL_C, &&LD_xHL_D, &&LD_xHL_E, &&LD_xHL_H, &&LD_xHL_L, &&HALT, &&LD_xHL_A,              /* 0x70 */ \
+  &&LD_A_B, &&LD_A_C, &&LD_A_D, &&LD_A_E, &&LD_A_H, &&LD_A_L, &&LD_A_xHL, &&LD_A_A,                        /* 0x78 */ \
+  &&ADD_B, &&ADD_C, &&ADD_D, &&ADD_E, &&ADD_H, &&ADD_L, &&ADD_xHL, &&ADD_A,                                /* 0x80 */ \
+  &&ADC_B, &&ADC_C, &&ADC_D, &&ADC_E, &&ADC_H, &&ADC_L, &&ADC_xHL, &&ADC_A,                                /* 0x88 */ \
+  &&SUB_B, &&SUB_C, &&SUB_D, &&SUB_E, &&SUB_H, &&SUB_L, &&SUB_xHL, &&SUB_A,                                /* 0x90 */ \
+  &&SBC_B, &&SBC_C, &&SBC_D, &&SBC_E, &&SBC_H, &&SBC_L, &&SBC_xHL, &&SBC_A,                                /* 0x98 */ \
+  &&AND_B, &&AND_C, &&AND_D, &&AND_E, &&AND_H, &&AND_L, &&AND_xHL, &&AND_A,                                /* 0xA0 */ \
+  &&XOR_B, &&XOR_C, &&XOR_D, &&XOR_E, &&XOR_H, &&XOR_L, &&XOR_xHL, &&XOR_A,                                /* 0xA8 */ \
+  &&OR_B, &&OR_C, &&OR_D, &&OR_E, &&OR_H, &&OR_L, &&OR_xHL, &&OR_A,                                        /* 0xB0 */ \
+  &&CP_B, &&CP_C, &&CP_D, &&CP_E, &&CP_H, &&CP_L, &&CP_xHL, &&CP_A,                                        /* 0xB8 */ \
+  &&RET_NZ, &&POP_BC, &&JP_NZ, &&JP, &&CALL_NZ, &&PUSH_BC, &&ADD_BYTE, &&RST00,                            /* 0xC0 */ \
+  &&RET_Z, &&RET, &&JP_Z, &&PFX_CB, &&CALL_Z, &&CALL, &&ADC_BYTE, &&RST08,                                 /* 0xC8 */ \
+  &&RET_NC, &&POP_DE, &&JP_NC, &&OUTA, &&CALL_NC, &&PUSH_DE, &&SUB_BYTE, &&RST10,                          /* 0xD0 */ \
+  &&RET_C, &&EXX, &&JP_C, &&INA, &&CALL_C, &&PFX_DD, &&SBC_BYTE, &&RST18,                                  /* 0xD8 */ \
+  &&RET_PO, &&POP_HL, &&JP_PO, &&EX_HL_xSP, &&CALL_PO, &&PUSH_HL, &&AND_BYTE, &&RST20,                     /* 0xE0 */ \
+  &&RET_PE, &&LD_PC_HL, &&JP_PE, &&EX_DE_HL, &&CALL_PE, &&PFX_ED, &&XOR_BYTE, &&RST28,                     /* 0xE8 */ \
+  &&RET_P, &&POP_AF, &&JP_P, &&DI, &&CALL_P, &&PUSH_AF, &&OR_BYTE, &&RST30,                                /* 0xF0 */ \
+  &&RET_M, &&LD_SP_HL, &&JP_M, &&EI, &&CALL_M, &&PFX_FD, &&CP_BYTE, &&RST38                                /* 0xF8 */
+
+// CB prefixed opcodes - CodesCB.h
+#define Z80_LABELS_CB \
+  &&RLC_B, &&RLC_C, &&RLC_D, &&RLC_E, &&RLC_H, &&RLC_L, &&RLC_xHL, &&RLC_A,                                /* 0x00 */ \
+  &&RRC_B, &&RRC_C, &&RRC_D, &&RRC_E, &&RRC_H, &&RRC_L, &&RRC_xHL, &&RRC_A,                                /* 0x08 */ \
+  &&RL_B, &&RL_C, &&RL_D, &&RL_E, &&RL_H, &&RL_L, &&RL_xHL, &&RL_A,                                        /* 0x10 */ \
+  &&RR_B, &&RR_C, &&RR_D, &&RR_E, &&RR_H, &&RR_L, &&RR_xHL, &&RR_A,                                        /* 0x18 */ \
+  &&SLA_B, &&SLA_C, &&SLA_D, &&SLA_E, &&SLA_H, &&SLA_L, &&SLA_xHL, &&SLA_A,                                /* 0x20 */ \
+  &&SRA_B, &&SRA_C, &&SRA_D, &&SRA_E, &&SRA_H, &&SRA_L, &&SRA_xHL, &&SRA_A,                                /* 0x28 */ \
+  &&SLL_B, &&SLL_C, &&SLL_D, &&SLL_E, &&SLL_H, &&SLL_L, &&SLL_xHL, &&SLL_A,                                /* 0x30 */ \
+  &&SRL_B, &&SRL_C, &&SRL_D, &&SRL_E, &&SRL_H, &&SRL_L, &&SRL_xHL, &&SRL_A,                                /* 0x38 */ \
+  &&BIT0_B, &&BIT0_C, &&BIT0_D, &&BIT0_E, &&BIT0_H, &&BIT0_L, &&BIT0_xHL, &&BIT0_A,                        /* 0x40 */ \
+  &&BIT1_B, &&BIT1_C, &&BIT1_D, &&BIT1_E, &&BIT1_H, &&BIT1_L, &&BIT1_xHL, &&BIT1_A,                        /* 0x48 */ \
+  &&BIT2_B, &&BIT2_C, &&BIT2_D, &&BIT2_E, &&BIT2_H, &&BIT2_L, &&BIT2_xHL, &&BIT2_A,                        /* 0x50 */ \
+  &&BIT3_B, &&BIT3_C, &&BIT3_D, &&BIT3_E, &&BIT3_H, &&BIT3_L, &&BIT3_xHL, &&BIT3_A,                        /* 0x58 */ \
+  &&BIT4_B, &&BIT4_C, &&BIT4_D, &&BIT4_E, &&BIT4_H, &&BIT4_L, &&BIT4_xHL, &&BIT4_A,                        /* 0x60 */ \
+  &&BIT5_B, &&BIT5_C, &&BIT5_D, &&BIT5_E, &&BIT5_H, &&BIT5_L, &&BIT5_xHL, &&BIT5_A,                        /* 0x68 */ \
+  &&BIT6_B, &&BIT6_C, &&BIT6_D, &&BIT6_E, &&BIT6_H, &&BIT6_L, &&BIT6_xHL, &&BIT6_A,                        /* 0x70 */ \
+  &&BIT7_B, &&BIT7_C, &&BIT7_D, &&BIT7_E, &&BIT7_H, &&BIT7_L, &&BIT7_xHL, &&BIT7_A,                        /* 0x78 */ \
+  &&RES0_B, &&RES0_C, &&RES0_D, &&RES0_E, &&RES0_H, &&RES0_L, &&RES0_xHL, &&RES0_A,                        /* 0x80 */ \
+  &&RES1_B, &&RES1_C, &&RES1_D, &&RES1_E, &&RES1_H, &&RES1_L, &&RES1_xHL, &&RES1_A,                        /* 0x88 */ \
+  &&RES2_B, &&RES2_C, &&RES2_D, &&RES2_E, &&RES2_H, &&RES2_L, &&RES2_xHL, &&RES2_A,                        /* 0x90 */ \
+  &&RES3_B, &&RES3_C, &&RES3_D, &&RES3_E, &&RES3_H, &&RES3_L, &&RES3_xHL, &&RES3_A,                        /* 0x98 */ \
+  &&RES4_B, &&RES4_C, &&RES4_D, &&RES4_E, &&RES4_H, &&RES4_L, &&RES4_xHL, &&RES4_A,                        /* 0xA0 */ \
+  &&RES5_B, &&RES5_C, &&RES5_D, &&RES5_E, &&RES5_H, &&RES5_L, &&RES5_xHL, &&RES5_A,                        /* 0xA8 */ \
+  &&RES6_B, &&RES6_C, &&RES6_D, &&RES6_E, &&RES6_H, &&RES6_L, &&RES6_xHL, &&RES6_A,                        /* 0xB0 */ \
+  &&RES7_B, &&RES7_C, &&RES7_D, &&RES7_E, &&RES7_H, &&RES7_L, &&RES7_xHL, &&RES7_A,                        /* 0xB8 */ \
+  &&SET0_B, &&SET0_C, &&SET0_D, &&SET0_E, &&SET0_H, &&SET0_L, &&SET0_xHL, &&SET0_A,                        /* 0xC0 */ \
+  &&SET1_B, &&SET1_C, &&SET1_D, &&SET1_E, &&SET1_H, &&SET1_L, &&SET1_xHL, &&SET1_A,                        /* 0xC8 */ \
+  &&SET2_B, &&SET2_C, &&SET2_D, &&SET2_E, &&SET2_H, &&SET2_L, &&SET2_xHL, &&SET2_A,                        /* 0xD0 */ \
+  &&SET3_B, &&SET3_C, &&SET3_D, &&SET3_E, &&SET3_H, &&SET3_L, &&SET3_xHL, &&SET3_A,                        /* 0xD8 */ \
+  &&SET4_B, &&SET4_C, &&SET4_D, &&SET4_E, &&SET4_H, &&SET4_L, &&SET4_xHL, &&SET4_A,                        /* 0xE0 */ \
+  &&SET5_B, &&SET5_C, &&SET5_D, &&SET5_E, &&SET5_H, &&SET5_L, &&SET5_xHL, &&SET5_A,                        /* 0xE8 */ \
+  &&SET6_B, &&SET6_C, &&SET6_D, &&SET6_E, &&SET6_H, &&SET6_L, &&SET6_xHL, &&SET6_A,                        /* 0xF0 */ \
+  &&SET7_B, &&SET7_C, &&SET7_D, &&SET7_E, &&SET7_H, &&SET7_L, &&SET7_xHL, &&SET7_A                         /* 0xF8 */
+
+// ED prefixed opcodes - CodesED.h plus a repeated ED prefix
+#define Z80_LABELS_ED \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x00 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x08 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x10 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x18 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x20 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x28 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x30 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x38 */ \
+  &&IN_B_xC, &&OUT_xC_B, &&SBC_HL_BC, &&LD_xWORDe_BC, &&NEG, &&RETN, &&IM_0, &&LD_I_A,                     /* 0x40 */ \
+  &&IN_C_xC, &&OUT_xC_C, &&ADC_HL_BC, &&LD_BC_xWORDe, &&Op_Default, &&RETI, &&Op_Default, &&LD_R_A,        /* 0x48 */ \
+  &&IN_D_xC, &&OUT_xC_D, &&SBC_HL_DE, &&LD_xWORDe_DE, &&Op_Default, &&Op_Default, &&IM_1, &&LD_A_I,        /* 0x50 */ \
+  &&IN_E_xC, &&OUT_xC_E, &&ADC_HL_DE, &&LD_DE_xWORDe, &&Op_Default, &&Op_Default, &&IM_2, &&LD_A_R,        /* 0x58 */ \
+  &&IN_H_xC, &&OUT_xC_H, &&SBC_HL_HL, &&LD_xWORDe_HL, &&Op_Default, &&Op_Default, &&Op_Default, &&RRD,     /* 0x60 */ \
+  &&IN_L_xC, &&OUT_xC_L, &&ADC_HL_HL, &&LD_HL_xWORDe, &&Op_Default, &&Op_Default, &&Op_Default, &&RLD,     /* 0x68 */ \
+  &&IN_F_xC, &&OUT_xC_F, &&SBC_HL_SP, &&LD_xWORDe_SP, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x70 */ \
+  &&IN_A_xC, &&OUT_xC_A, &&ADC_HL_SP, &&LD_SP_xWORDe, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x78 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x80 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x88 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x90 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0x98 */ \
+  &&LDI, &&CPI, &&INI, &&OUTI, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default,                     /* 0xA0 */ \
+  &&LDD, &&CPD, &&IND, &&OUTD, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default,                     /* 0xA8 */ \
+  &&LDIR, &&CPIR, &&INIR, &&OTIR, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default,                  /* 0xB0 */ \
+  &&LDDR, &&CPDR, &&INDR, &&OTDR, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default,                  /* 0xB8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xC0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xC8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xD0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xD8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xE0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&PFX_ED, &&Op_Default, &&Op_Default, /* 0xE8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, /* 0xF0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default /* 0xF8 */
+
+// DD/FD prefixed opcodes - CodesXX.h plus the prefix bytes
+#define Z80_LABELS_XX \
+  &&NOP, &&LD_BC_WORD, &&LD_xBC_A, &&INC_BC, &&INC_B, &&DEC_B, &&LD_B_BYTE, &&RLCA,                        /* 0x00 */ \
+  &&EX_AF_AF, &&ADD_HL_BC, &&LD_A_xBC, &&DEC_BC, &&INC_C, &&DEC_C, &&LD_C_BYTE, &&RRCA,                    /* 0x08 */ \
+  &&Op_Default, &&LD_DE_WORD, &&LD_xDE_A, &&INC_DE, &&INC_D, &&DEC_D, &&LD_D_BYTE, &&RLA,                  /* 0x10 */ \
+  &&Op_Default, &&ADD_HL_DE, &&LD_A_xDE, &&DEC_DE, &&INC_E, &&DEC_E, &&LD_E_BYTE, &&RRA,                   /* 0x18 */ \
+  &&Op_Default, &&LD_HL_WORD, &&LD_xWORD_HL, &&INC_HL, &&INC_H, &&DEC_H, &&LD_H_BYTE, &&Op_Default,        /* 0x20 */ \
+  &&Op_Default, &&ADD_HL_HL, &&LD_HL_xWORD, &&DEC_HL, &&INC_L, &&DEC_L, &&LD_L_BYTE, &&CPL,                /* 0x28 */ \
+  &&Op_Default, &&LD_SP_WORD, &&LD_xWORD_A, &&INC_SP, &&INC_xHL, &&DEC_xHL, &&LD_xHL_BYTE, &&SCF,          /* 0x30 */ \
+  &&Op_Default, &&ADD_HL_SP, &&LD_A_xWORD, &&DEC_SP, &&INC_A, &&DEC_A, &&LD_A_BYTE, &&Op_Default,          /* 0x38 */ \
+  &&LD_B_B, &&LD_B_C, &&LD_B_D, &&LD_B_E, &&LD_B_H, &&LD_B_L, &&LD_B_xHL, &&LD_B_A,                        /* 0x40 */ \
+  &&LD_C_B, &&LD_C_C, &&LD_C_D, &&LD_C_E, &&LD_C_H, &&LD_C_L, &&LD_C_xHL, &&LD_C_A,                        /* 0x48 */ \
+  &&LD_D_B, &&LD_D_C, &&LD_D_D, &&LD_D_E, &&LD_D_H, &&LD_D_L, &&LD_D_xHL, &&LD_D_A,                        /* 0x50 */ \
+  &&LD_E_B, &&LD_E_C, &&LD_E_D, &&LD_E_E, &&LD_E_H, &&LD_E_L, &&LD_E_xHL, &&LD_E_A,                        /* 0x58 */ \
+  &&LD_H_B, &&LD_H_C, &&LD_H_D, &&LD_H_E, &&LD_H_H, &&LD_H_L, &&LD_H_xHL, &&LD_H_A,                        /* 0x60 */ \
+  &&LD_L_B, &&LD_L_C, &&LD_L_D, &&LD_L_E, &&LD_L_H, &&LD_L_L, &&LD_L_xHL, &&LD_L_A,                        /* 0x68 */ \
+  &&LD_xHL_B, &&LD_xHL_C, &&LD_xHL_D, &&LD_xHL_E, &&LD_xHL_H, &&LD_xHL_L, &&Op_Default, &&LD_xHL_A,        /* 0x70 */ \
+  &&LD_A_B, &&LD_A_C, &&LD_A_D, &&LD_A_E, &&LD_A_H, &&LD_A_L, &&LD_A_xHL, &&LD_A_A,                        /* 0x78 */ \
+  &&ADD_B, &&ADD_C, &&ADD_D, &&ADD_E, &&ADD_H, &&ADD_L, &&ADD_xHL, &&ADD_A,                                /* 0x80 */ \
+  &&ADC_B, &&ADC_C, &&ADC_D, &&ADC_E, &&ADC_H, &&ADC_L, &&ADC_xHL, &&ADC_A,                                /* 0x88 */ \
+  &&SUB_B, &&SUB_C, &&SUB_D, &&SUB_E, &&SUB_H, &&SUB_L, &&SUB_xHL, &&SUB_A,                                /* 0x90 */ \
+  &&SBC_B, &&SBC_C, &&SBC_D, &&SBC_E, &&SBC_H, &&SBC_L, &&SBC_xHL, &&SBC_A,                                /* 0x98 */ \
+  &&AND_B, &&AND_C, &&AND_D, &&AND_E, &&AND_H, &&AND_L, &&AND_xHL, &&AND_A,                                /* 0xA0 */ \
+  &&XOR_B, &&XOR_C, &&XOR_D, &&XOR_E, &&XOR_H, &&XOR_L, &&XOR_xHL, &&XOR_A,                                /* 0xA8 */ \
+  &&OR_B, &&OR_C, &&OR_D, &&OR_E, &&OR_H, &&OR_L, &&OR_xHL, &&OR_A,                                        /* 0xB0 */ \
+  &&CP_B, &&CP_C, &&CP_D, &&CP_E, &&CP_H, &&CP_L, &&CP_xHL, &&CP_A,                                        /* 0xB8 */ \
+  &&Op_Default, &&POP_BC, &&Op_Default, &&Op_Default, &&Op_Default, &&PUSH_BC, &&ADD_BYTE, &&RST00,        /* 0xC0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&PFX_CB, &&Op_Default, &&Op_Default, &&ADC_BYTE, &&RST08,     /* 0xC8 */ \
+  &&Op_Default, &&POP_DE, &&Op_Default, &&OUTA, &&Op_Default, &&PUSH_DE, &&SUB_BYTE, &&RST10,              /* 0xD0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&INA, &&Op_Default, &&PFX_DD, &&SBC_BYTE, &&RST18,            /* 0xD8 */ \
+  &&Op_Default, &&POP_HL, &&Op_Default, &&EX_HL_xSP, &&Op_Default, &&PUSH_HL, &&AND_BYTE, &&RST20,         /* 0xE0 */ \
+  &&Op_Default, &&LD_PC_HL, &&Op_Default, &&EX_DE_HL, &&Op_Default, &&Op_Default, &&XOR_BYTE, &&RST28,     /* 0xE8 */ \
+  &&Op_Default, &&POP_AF, &&Op_Default, &&Op_Default, &&Op_Default, &&PUSH_AF, &&OR_BYTE, &&RST30,         /* 0xF0 */ \
+  &&Op_Default, &&LD_SP_HL, &&Op_Default, &&Op_Default, &&Op_Default, &&PFX_FD, &&CP_BYTE, &&RST38         /* 0xF8 */
+
+// DDCB/FDCB prefixed opcodes - CodesXCB.h
+#define Z80_LABELS_XXCB \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RLC_xHL, &&Op_Default, /* 0x00 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RRC_xHL, &&Op_Default, /* 0x08 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RL_xHL, &&Op_Default, /* 0x10 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RR_xHL, &&Op_Default, /* 0x18 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SLA_xHL, &&Op_Default, /* 0x20 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SRA_xHL, &&Op_Default, /* 0x28 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SLL_xHL, &&Op_Default, /* 0x30 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SRL_xHL, &&Op_Default, /* 0x38 */ \
+  &&BIT0_B, &&BIT0_C, &&BIT0_D, &&BIT0_E, &&BIT0_H, &&BIT0_L, &&BIT0_xHL, &&BIT0_A,                        /* 0x40 */ \
+  &&BIT1_B, &&BIT1_C, &&BIT1_D, &&BIT1_E, &&BIT1_H, &&BIT1_L, &&BIT1_xHL, &&BIT1_A,                        /* 0x48 */ \
+  &&BIT2_B, &&BIT2_C, &&BIT2_D, &&BIT2_E, &&BIT2_H, &&BIT2_L, &&BIT2_xHL, &&BIT2_A,                        /* 0x50 */ \
+  &&BIT3_B, &&BIT3_C, &&BIT3_D, &&BIT3_E, &&BIT3_H, &&BIT3_L, &&BIT3_xHL, &&BIT3_A,                        /* 0x58 */ \
+  &&BIT4_B, &&BIT4_C, &&BIT4_D, &&BIT4_E, &&BIT4_H, &&BIT4_L, &&BIT4_xHL, &&BIT4_A,                        /* 0x60 */ \
+  &&BIT5_B, &&BIT5_C, &&BIT5_D, &&BIT5_E, &&BIT5_H, &&BIT5_L, &&BIT5_xHL, &&BIT5_A,                        /* 0x68 */ \
+  &&BIT6_B, &&BIT6_C, &&BIT6_D, &&BIT6_E, &&BIT6_H, &&BIT6_L, &&BIT6_xHL, &&BIT6_A,                        /* 0x70 */ \
+  &&BIT7_B, &&BIT7_C, &&BIT7_D, &&BIT7_E, &&BIT7_H, &&BIT7_L, &&BIT7_xHL, &&BIT7_A,                        /* 0x78 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES0_xHL, &&Op_Default, /* 0x80 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES1_xHL, &&Op_Default, /* 0x88 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES2_xHL, &&Op_Default, /* 0x90 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES3_xHL, &&Op_Default, /* 0x98 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES4_xHL, &&Op_Default, /* 0xA0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES5_xHL, &&Op_Default, /* 0xA8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES6_xHL, &&Op_Default, /* 0xB0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&RES7_xHL, &&Op_Default, /* 0xB8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET0_xHL, &&Op_Default, /* 0xC0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET1_xHL, &&Op_Default, /* 0xC8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET2_xHL, &&Op_Default, /* 0xD0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET3_xHL, &&Op_Default, /* 0xD8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET4_xHL, &&Op_Default, /* 0xE0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET5_xHL, &&Op_Default, /* 0xE8 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET6_xHL, &&Op_Default, /* 0xF0 */ \
+  &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&Op_Default, &&SET7_xHL, &&Op_Default /* 0xF8 */
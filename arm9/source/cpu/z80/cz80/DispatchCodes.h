@@ -0,0 +1,36 @@
+/******************************************************************************
+*  SugarDS Z80 CPU
+*
+* Note: Most of this file is from the ColEm emulator core by Marat Fayzullin
+*       but heavily modified for specific NDS use. If you want to use this
+*       code, you are advised to seek out the much more portable ColEm core
+*       and contact Marat.
+*
+******************************************************************************/
+
+/** Z80: portable Z80 emulator *******************************/
+/**                                                         **/
+/**                      DispatchCodes.h                    **/
+/**                                                         **/
+/** This file pulls in the Codes*.h file named by Z80_CODES **/
+/** for the opcode dispatch. With Z80_THREADED defined the  **/
+/** case/default/break keywords are turned into labels and  **/
+/** a jump to the end of the table - only while that one    **/
+/** file is being read. It is included from Z80.c.          **/
+/*************************************************************/
+
+#ifdef Z80_THREADED
+#define case
+#define default               Op_Default
+#define break                 goto Op_End
+#endif
+
+#include Z80_CODES
+
+#ifdef Z80_THREADED
+#undef case
+#undef default
+#undef break
+#endif
+
+#undef Z80_CODES
@@ -137,6 +137,62 @@ static const byte CyclesXXCB[256] __attribute__((section(".dtcm"))) =
    4,  4,  4,  4,  4,  4, 24,  4,        4,  4,  4,  4,  4,  4, 24,  4    // 0xF0
 };
 
+#ifdef Z80_BLOCK_CACHE
+// -----------------------------------------------------------------
+// Length in bytes of each un-prefixed opcode, with the high bit set
+// for anything that ends a decoded block: jumps, calls, returns,
+// restarts, HALT, EI and the prefix bytes (which fetch for themselves).
+// -----------------------------------------------------------------
+static const byte OpLength[256] =
+{
+  //00    01    02    03    04    05    06    07    08    09    0A    0B    0C    0D    0E    0F
+  0x01, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,  // 0x00
+  0x82, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x82, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,  // 0x10
+  0x82, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x82, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,  // 0x20
+  0x82, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x82, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,  // 0x30
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x40
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x50
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x60
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x81, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x70
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x80
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0x90
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0xA0
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  // 0xB0
+  0x81, 0x01, 0x83, 0x83, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x81, 0x83, 0x83, 0x02, 0x81,  // 0xC0
+  0x81, 0x01, 0x83, 0x02, 0x83, 0x01, 0x02, 0x81, 0x81, 0x01, 0x83, 0x02, 0x83, 0x81, 0x02, 0x81,  // 0xD0
+  0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x01, 0x83, 0x81, 0x02, 0x81,  // 0xE0
+  0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81, 0x81, 0x01, 0x83, 0x81, 0x83, 0x81, 0x02, 0x81   // 0xF0
+};
+#endif
+
+#ifdef Z80_LAZY_FLAGS
+// -----------------------------------------------------------------
+// Un-prefixed opcodes that look at F (or write only part of it) and
+// so need any pending lazy flags worked out before they run. The
+// prefix bytes are all marked - the prefixed tables are not lazy.
+// -----------------------------------------------------------------
+static const byte FlagRead[256] =
+{
+  //0 1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+  0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1,  // 0x00
+  0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1,  // 0x10
+  1, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1,  // 0x20
+  1, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 1,  // 0x30
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x40
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x50
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x60
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x70
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x80
+  0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0x90
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  // 0xA0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  // 0xB0
+  1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 1, 1, 0, 1, 0,  // 0xC0
+  1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, 0,  // 0xD0
+  1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 1, 1, 0, 0,  // 0xE0
+  1, 1, 1, 0, 1, 1, 0, 0, 1, 0, 1, 1, 1, 1, 0, 0   // 0xF0
+};
+#endif
+
 static const byte ZSTable[256] __attribute__((section(".dtcm"))) =
 {
   Z_FLAG,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
@@ -22,12 +22,30 @@
 /**     commercially. Please, notify me, if you make any    **/
 /**     changes to this file.                               **/
 /*************************************************************/
+#ifdef ARM9
 #include <nds.h>
+#else
+// ------------------------------------------------------------------------------
+// Built off the DS (e.g. to exercise or time the core on a PC against a flat 64K
+// map) - we only need the libnds types and ITCM tag. The host must provide CPU,
+// MemoryMapR/W[], cpu_readport_ams()/cpu_writeport_ams() and the globals below.
+// ------------------------------------------------------------------------------
+#include <stdint.h>
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+#define ITCM_CODE
+#endif
 #include "Z80.h"
 #include "Tables.h"
 #include <stdio.h>
+#include <string.h>
+#ifdef ARM9
 #include "../../../printf.h"
 #include "../../../AmsUtils.h"
+#else
+extern u8 hack_int_acknoledge;
+#endif
 
 extern Z80 CPU;
 
@@ -52,6 +70,8 @@ extern void ConfigureMemory(void);
 /*************************************************************/
 extern u8 *MemoryMapR[4];
 extern u8 *MemoryMapW[4];
+extern u32 *ScreenDirtyW[4];    // Write stamps per 2K block - pre-offset per page like MemoryMapW[], NULL off the screen
+extern u32 ScreenLine;
 
 // ------------------------------------------------------
 // These defines and inline functions are to map maximum
@@ -76,7 +96,22 @@ inline byte OpZ80(word A)
 // The Amstrad CPC allows write-through to RAM even if a ROM/Cart/OS page is mapped in for
 // reading... this means that any write will always make it to RAM and so this is trivial.
 // -------------------------------------------------------------------------------------------
-inline void WrZ80(word A, byte value)   {MemoryMapW[(A)>>14][A] = value;}
+#ifdef Z80_BLOCK_CACHE
+extern u8 BlockCodePage[256];
+extern void InvalidateZ80Page(byte Page);
+INLINE void WrZ80(word A, byte value)
+{
+    MemoryMapW[(A)>>14][A] = value;
+    if (ScreenDirtyW[(A)>>14]) ScreenDirtyW[(A)>>14][(A)>>11] = ScreenLine;    // So the renderer knows the screen may have changed
+    if (BlockCodePage[A>>8]) InvalidateZ80Page(A>>8);  // Self-modifying code - drop any decoded blocks on this page
+}
+#else
+INLINE void WrZ80(word A, byte value)
+{
+    MemoryMapW[(A)>>14][A] = value;
+    if (ScreenDirtyW[(A)>>14]) ScreenDirtyW[(A)>>14][(A)>>11] = ScreenLine;    // Only the screen's pages are stamped
+}
+#endif
 
 // -------------------------------------------------------------------
 // And these two macros will give us access to the Z80 I/O ports...
@@ -135,7 +170,7 @@ inline void WrZ80(word A, byte value)   {MemoryMapW[(A)>>14][A] = value;}
 #define M_RES(Bit,Rg) Rg&=~(1<<Bit)
 
 #define M_POP(Rg)      \
-  CPU.Rg.B.l=OpZ80(CPU.SP.W++);CPU.Rg.B.h=OpZ80(CPU.SP.W++)
+  CPU.Rg.B.l=RdZ80(CPU.SP.W++);CPU.Rg.B.h=RdZ80(CPU.SP.W++)
 #define M_PUSH(Rg)     \
   WrZ80(--CPU.SP.W,CPU.Rg.B.h);WrZ80(--CPU.SP.W,CPU.Rg.B.l)
 
@@ -147,7 +182,7 @@ inline void WrZ80(word A, byte value)   {MemoryMapW[(A)>>14][A] = value;}
 
 #define M_JP  CPU.PC.W = (u32)OpZ80(CPU.PC.W) | ((u32)OpZ80(CPU.PC.W+1) << 8);
 #define M_JR  CPU.PC.W+=(offset)OpZ80(CPU.PC.W)+1;JumpZ80(CPU.PC.W)
-#define M_RET CPU.PC.B.l=OpZ80(CPU.SP.W++);CPU.PC.B.h=OpZ80(CPU.SP.W++);JumpZ80(CPU.PC.W)
+#define M_RET CPU.PC.B.l=RdZ80(CPU.SP.W++);CPU.PC.B.h=RdZ80(CPU.SP.W++);JumpZ80(CPU.PC.W)
 
 #define M_RST(Ad)      \
   WrZ80(--CPU.SP.W,CPU.PC.B.h);WrZ80(--CPU.SP.W,CPU.PC.B.l);CPU.PC.W=Ad;JumpZ80(Ad)
@@ -237,6 +272,89 @@ inline void WrZ80(word A, byte value)   {MemoryMapW[(A)>>14][A] = value;}
     (J.W? 0:Z_FLAG)|(J.B.h&S_FLAG);                            \
   CPU.HL.W=J.W
 
+#ifdef Z80_LAZY_FLAGS
+// ------------------------------------------------------------------------------------------
+// Lazy flags. The common 8-bit ALU macros don't build F - they note the operation and its
+// operands and F is only worked out (exactly as above) once something looks at it. Which
+// un-prefixed opcodes look is in FlagRead[] and the prefixed tables always get a real F.
+// The carry is cheap and INC/DEC need the previous one so that is always kept current.
+// ExecZ80() never returns with flags pending so nothing outside the core ever sees this.
+// ------------------------------------------------------------------------------------------
+#define LZ_NONE 0
+#define LZ_ADD  1
+#define LZ_SUB  2       // Also CP - same flags, A just isn't written
+#define LZ_AND  3
+#define LZ_OR   4       // Also XOR
+#define LZ_INC  5
+#define LZ_DEC  6
+
+u8 LazyOp = LZ_NONE;    // Last flag producing operation or LZ_NONE if F is current
+u8 LazyA, LazyV, LazyR; // A before, the operand and the result
+u8 LazyC;               // The carry - always valid while LazyOp is set
+
+#define M_LAZY(Op,A,V,Res,C) LazyOp=Op;LazyA=A;LazyV=V;LazyR=Res;LazyC=C
+
+#undef M_ADD
+#define M_ADD(Rg)      \
+  J.W=CPU.AF.B.h+Rg;    \
+  M_LAZY(LZ_ADD,CPU.AF.B.h,Rg,J.B.l,J.B.h&C_FLAG); \
+  CPU.AF.B.h=J.B.l
+
+#undef M_SUB
+#define M_SUB(Rg)      \
+  J.W=CPU.AF.B.h-Rg;    \
+  M_LAZY(LZ_SUB,CPU.AF.B.h,Rg,J.B.l,J.B.h&C_FLAG); \
+  CPU.AF.B.h=J.B.l
+
+#undef M_CP
+#define M_CP(Rg)       \
+  J.W=CPU.AF.B.h-Rg;    \
+  M_LAZY(LZ_SUB,CPU.AF.B.h,Rg,J.B.l,J.B.h&C_FLAG)
+
+#undef M_AND
+#undef M_OR
+#undef M_XOR
+#define M_AND(Rg) CPU.AF.B.h&=Rg;LazyOp=LZ_AND;LazyR=CPU.AF.B.h;LazyC=0
+#define M_OR(Rg)  CPU.AF.B.h|=Rg;LazyOp=LZ_OR;LazyR=CPU.AF.B.h;LazyC=0
+#define M_XOR(Rg) CPU.AF.B.h^=Rg;LazyOp=LZ_OR;LazyR=CPU.AF.B.h;LazyC=0
+
+#undef M_INC
+#define M_INC(Rg)       \
+  Rg++;                 \
+  if(!LazyOp) LazyC=CPU.AF.B.l&C_FLAG; \
+  LazyOp=LZ_INC;LazyR=Rg;
+
+#undef M_DEC
+#define M_DEC(Rg)       \
+  Rg--;                 \
+  if(!LazyOp) LazyC=CPU.AF.B.l&C_FLAG; \
+  LazyOp=LZ_DEC;LazyR=Rg;
+
+static void LazyFlags(void)
+{
+    switch (LazyOp)
+    {
+        case LZ_ADD:
+            CPU.AF.B.l = (~(LazyA^LazyV)&(LazyV^LazyR)&0x80? V_FLAG:0) | LazyC | ZSTable[LazyR] | ((LazyA^LazyV^LazyR)&H_FLAG);
+            break;
+        case LZ_SUB:
+            CPU.AF.B.l = ((LazyA^LazyV)&(LazyA^LazyR)&0x80? V_FLAG:0) | N_FLAG | LazyC | ZSTable[LazyR] | ((LazyA^LazyV^LazyR)&H_FLAG);
+            break;
+        case LZ_AND: CPU.AF.B.l = H_FLAG|PZSTable[LazyR];     break;
+        case LZ_OR:  CPU.AF.B.l = PZSTable[LazyR];            break;
+        case LZ_INC: CPU.AF.B.l = LazyC|ZSTable_INC[LazyR];   break;
+        case LZ_DEC: CPU.AF.B.l = LazyC|ZSTable_DEC[LazyR];   break;
+    }
+    LazyOp = LZ_NONE;
+}
+
+#define LAZY_FLAGS(I)  if (LazyOp && FlagRead[I]) LazyFlags()  // Before running opcode I
+#define LAZY_DONE      if (LazyOp) LazyFlags()                  // Before leaving the core
+#else
+#define LAZY_FLAGS(I)
+#define LAZY_DONE
+#endif
+
 
 enum Codes
 {
@@ -377,7 +495,12 @@ void ResetZ80(Z80 *R)
   CPU.TrapBadOps = 1;
   CPU.IAutoReset = 1;
   CPU.TStates    = 0;
+  IdleSkipped    = 0;
 
+#ifdef Z80_PROFILE
+  ProfileResetZ80();
+#endif
+  FlushZ80();
   JumpZ80(CPU.PC.W);
 }
 
@@ -458,6 +581,378 @@ ITCM_CODE void IntZ80(Z80 *R,word Vector)
 }
 
 
+#ifdef Z80_BLOCK_CACHE
+// --------------------------------------------------------------------------------------------
+// Decoded block cache. A block is a straight run of opcodes from a given PC that ends on the
+// first jump, call, return, restart, HALT, EI or prefix and never leaves its 256 byte page.
+// We remember how many opcodes it holds and the T-states of all but the last one - if the
+// whole block fits in what is left of this slice we can run it without checking the cycle
+// target each opcode and with opcodes/operands fetched through a single memory map pointer.
+// Blocks go stale when the memory map changes or when a write lands on a page that we have
+// decoded code from (self-modifying code is common on the CPC).
+// --------------------------------------------------------------------------------------------
+#define Z80_BLOCKS  512     // Must be a power of 2
+
+typedef struct
+{
+    u32  PC;                // Z80 address of the first opcode
+    u32  Gen;               // BlockGen when this block was decoded
+    u32  PageGen;           // BlockPageGen[] of the page when this block was decoded
+    u16  Cycles;            // T-states of all but the last opcode
+    u16  Ops;               // Opcodes in the block - zero if it can't be cached
+} Z80Block;
+
+Z80Block BlockCache[Z80_BLOCKS];
+u32 BlockGen = 1;
+u32 BlockPageGen[256];
+u8  BlockCodePage[256];
+u8  BlockStop = 0;
+u8 *BlockMap[4];
+
+u32 BlockHits = 0;
+u32 BlockMisses = 0;
+u32 BlockInvalidates = 0;
+
+// ---------------------------------------------------------------
+// Drop every decoded block - the next lookup of each will miss.
+// ---------------------------------------------------------------
+void FlushZ80(void)
+{
+    BlockGen++;
+    memset(BlockCodePage, 0x00, sizeof(BlockCodePage));
+    BlockStop = 1;
+    BlockInvalidates++;
+}
+
+// ------------------------------------------------------------------------
+// Called by ConfigureMemory() - only flush if the read map really moved
+// as the RMR is also written for every graphics mode change.
+// ------------------------------------------------------------------------
+ITCM_CODE void RemapZ80(void)
+{
+    if (memcmp(BlockMap, MemoryMapR, sizeof(BlockMap)))
+    {
+        memcpy(BlockMap, MemoryMapR, sizeof(BlockMap));
+        FlushZ80();
+    }
+}
+
+// ------------------------------------------------------------------------
+// A write has landed on a page holding decoded code. Invalidate just that
+// page and stop the running block in case it was the one being modified.
+// ------------------------------------------------------------------------
+void InvalidateZ80Page(byte Page)
+{
+    BlockCodePage[Page] = 0;
+    BlockPageGen[Page]++;
+    BlockStop = 1;
+    BlockInvalidates++;
+}
+
+static void DecodeBlock(Z80Block *Block)
+{
+    word A = CPU.PC.W;
+    u8 *Mem = MemoryMapR[A>>14];
+    u16 Ops = 0;
+    u16 T = 0;
+    byte I, Len;
+
+    BlockMisses++;
+
+    while (1)
+    {
+        I = Mem[A];
+        Len = OpLength[I] & 0x7F;
+        if (((A & 0xFF) + Len) > 0x100) break;                  // Don't let an opcode straddle the page
+        Ops++; A += Len;
+        if ((OpLength[I] & 0x80) || !(A & 0xFF)) break;         // That was the last opcode
+        T += Cycles[I];
+    }
+
+    Block->PC      = CPU.PC.W;
+    Block->Gen     = BlockGen;
+    Block->PageGen = BlockPageGen[CPU.PC.W>>8];
+    Block->Cycles  = T;
+    Block->Ops     = Ops;
+    BlockCodePage[CPU.PC.W>>8] = 1;
+}
+#endif // Z80_BLOCK_CACHE
+
+#ifdef Z80_PROFILE
+// --------------------------------------------------------------------------------------------
+// Execution profiler. Every opcode run is counted along with the T-states it took (including
+// any idle time skipped) against the PC it started at and against the 16K bank mapped in for
+// reading at that PC. Banks are told apart by where they live in DS memory so the report can
+// say whether time went into the firmware, BASIC, AMSDOS or a given RAM/cart bank. This needs
+// 512K for the per-PC tables so it is strictly a debug build option.
+// --------------------------------------------------------------------------------------------
+u32 ProfileCount[0x10000];
+u32 ProfileCycles[0x10000];
+u32 ProfileBankCycles[PROFILE_BANKS];
+u8 *ProfileBankBase[PROFILE_BANKS];
+u8  ProfileMap[4];
+
+// ------------------------------------------------------------------------
+// Called by ConfigureMemory() - find (or add) the bank behind each page.
+// ------------------------------------------------------------------------
+void RemapZ80(void)
+{
+    for (u8 p=0; p<4; p++)
+    {
+        u8 *Base = MemoryMapR[p] + (p << 14);
+        u8 b;
+        for (b=0; b<PROFILE_BANKS-1; b++)
+        {
+            if (ProfileBankBase[b] == Base) break;
+            if (ProfileBankBase[b] == NULL) {ProfileBankBase[b] = Base; break;}
+        }
+        ProfileMap[p] = b;
+    }
+}
+
+void ProfileResetZ80(void)
+{
+    memset(ProfileCount, 0x00, sizeof(ProfileCount));
+    memset(ProfileCycles, 0x00, sizeof(ProfileCycles));
+    memset(ProfileBankCycles, 0x00, sizeof(ProfileBankCycles));
+    memset(ProfileBankBase, 0x00, sizeof(ProfileBankBase));
+    if (MemoryMapR[0]) RemapZ80();
+}
+
+#define PROFILE_START   word ProfilePC = CPU.PC.W; u32 ProfileTS = CPU.TStates
+#define PROFILE_END     ProfileCount[ProfilePC]++; \
+                        ProfileCycles[ProfilePC] += CPU.TStates - ProfileTS; \
+                        ProfileBankCycles[ProfileMap[ProfilePC>>14]] += CPU.TStates - ProfileTS
+#else
+#define PROFILE_START
+#define PROFILE_END
+#endif
+
+// --------------------------------------------------------------------------------------------
+// The cycle ExecZ80() is running up to - nothing outside the CPU changes until then as that is
+// the next scheduled event. Zero while we must not run past the current opcode (the EI delay).
+// --------------------------------------------------------------------------------------------
+u32 RunLimit = 0;
+
+// --------------------------------------------------------------------------------------------
+// Idle fast-forward. As nothing outside the CPU changes until RunLimit, a CPU sitting in HALT, in a JR to itself or polling the
+// PPI Port B for the VSYNC bit will do exactly the same thing over and over until then. Rather
+// than spin through it, we account for all of those opcodes at once - the T-states and the R
+// register end up precisely where they would have if we had run them one at a time.
+// --------------------------------------------------------------------------------------------
+u32 IdleSkipped = 0;
+
+// Opcode (of Cost T-states and Refresh M1 cycles) repeats until Limit - run it out
+static void IdleRepeat(u32 Limit, u32 Cost, u32 Refresh)
+{
+    u32 n = (Limit - CPU.TStates + Cost - 1) / Cost;
+    CPU.TStates += n * Cost;
+    CPU.R       += n * Refresh;
+    IdleSkipped += n * Cost;
+}
+
+// ------------------------------------------------------------------------------------------
+// Just took a JR NC/JR C backwards. Is this the classic wait-for-VSYNC loop (optionally with
+// the LD B,&F5 inside the loop)? Reading &F5xx has no side effects and Port B can't change
+// until the next event. Once the loop has settled (A and F hold what one more pass would
+// leave in them) each pass leaves every register exactly as it was.
+//
+//      LD   B,&F5          ; 06 F5    (optional)
+//  .wt IN   A,(C)          ; ED 78
+//      RRA                 ; 1F
+//      JR   NC,.wt         ; 30 FB    (30 F9 with the LD) - or JR C
+// ------------------------------------------------------------------------------------------
+static void IdlePoll(u32 Limit, byte JrOp)
+{
+    word A = CPU.PC.W;
+    u32 Cost = Cycles[PFX_ED] + CyclesED[IN_A_xC] + Cycles[RRA] + Cycles[JrOp];
+    u32 Refresh = 4;
+
+    if (RdZ80(A) == LD_B_BYTE)
+    {
+        if (RdZ80(A+1) != 0xF5) return;
+        Cost += Cycles[LD_B_BYTE]; Refresh++; A += 2;
+    }
+    if ((RdZ80(A) != PFX_ED) || (RdZ80(A+1) != IN_A_xC) || (RdZ80(A+2) != RRA)) return;
+    if ((RdZ80(A+3) != JrOp) || ((word)(A + 5 + (offset)RdZ80(A+4)) != (word)CPU.PC.W)) return;
+
+    // What another pass would leave in A and F - skip only if that is exactly what we have now
+    byte V = InZ80(CPU.BC.W);
+    if ((V & C_FLAG) != (JrOp == JR_C ? C_FLAG:0)) return;  // Next pass falls out of the loop
+    if (CPU.AF.B.h != ((V >> 1) | (V << 7))) return;
+    if (CPU.AF.B.l != ((PZSTable[V] & ~(C_FLAG|N_FLAG|H_FLAG)) | (V & C_FLAG))) return;
+
+    u32 n = (Limit - CPU.TStates) / Cost; // Only whole passes - the last one is run normally
+    CPU.TStates += n * Cost;
+    CPU.R       += n * Refresh;
+    IdleSkipped += n * Cost;
+}
+
+#define M_IDLE_HALT    if (CPU.TStates < RunLimit) IdleRepeat(RunLimit, Cycles[HALT], 1)
+#define M_IDLE_JR      if ((CPU.TStates < RunLimit) && (RdZ80(CPU.PC.W) == JR) && (RdZ80(CPU.PC.W+1) == 0xFE)) IdleRepeat(RunLimit, Cycles[JR], 1)
+#define M_IDLE_POLL(Op) if ((CPU.BC.B.h == 0xF5) && (CPU.TStates < RunLimit)) IdlePoll(RunLimit, Op)
+
+// --------------------------------------------------------------------------------------------
+// Bulk block instructions. A repeating LDIR/LDDR/CPIR/INIR/OTIR re-executes itself one pass
+// per fetch - a 16K screen clear would be 16K trips through the dispatcher. Once a pass has
+// decided to repeat, we run as many further passes as would start before RunLimit right here,
+// charging exactly the T-states and R increments the single passes would have.
+// --------------------------------------------------------------------------------------------
+#define MIN(a,b) ((a) < (b) ? (a):(b))
+
+// Runs never cross a 16K page so one ScreenDirtyW[] page covers all of the 2K blocks written
+#define BULK_STAMP(A,Len)   if (ScreenDirtyW[(A)>>14]) for (u32 B=(A)>>11; B<=((A)+(Len)-1)>>11; B++) ScreenDirtyW[(A)>>14][B] = ScreenLine
+#ifdef Z80_BLOCK_CACHE
+#define BULK_WRITTEN(A,Len) BULK_STAMP(A,Len); for (u32 P=(A)>>8; P<=((A)+(Len)-1)>>8; P++) if (BlockCodePage[P]) InvalidateZ80Page(P)
+#else
+#define BULK_WRITTEN(A,Len) BULK_STAMP(A,Len)
+#endif
+
+// How many passes of Cost T-states each would start before RunLimit
+INLINE u32 RepeatPasses(u32 Cost)
+{
+    return (CPU.TStates < RunLimit) ? (RunLimit - CPU.TStates + Cost - 1) / Cost : 0;
+}
+
+// ------------------------------------------------------------------------------------------
+// LDIR/LDDR - copied in runs that don't cross a 16K page of either map. Where source and
+// destination overlap such that a byte is read after it was written (the classic fill with
+// DE=HL+1) we copy byte by byte so the pattern repeats just as it does on the real thing.
+// We stop short of a pass that would write over the LDIR/LDDR itself.
+// ------------------------------------------------------------------------------------------
+static void BulkCopy(byte Op)
+{
+    u32 Cost = Cycles[PFX_ED] + CyclesED[Op];
+    u32 N = MIN(RepeatPasses(Cost), CPU.BC.W);
+    word Gap;
+    u32 Len, i;
+    u8 *Src, *Dst;
+
+    if ((RdZ80(CPU.PC.W) != PFX_ED) || (RdZ80(CPU.PC.W+1) != Op)) return;  // The pass just run wrote over it
+    Gap = (Op == LDIR) ? (word)(CPU.PC.W - CPU.DE.W) : (word)(CPU.DE.W - CPU.PC.W - 1);
+    if (Gap == 0xFFFF) Gap = 0;     // Next byte written is the ED itself
+    N = MIN(N, Gap);
+    if (!N) return;
+
+    CPU.TStates += N * Cost;
+    CPU.R       += N * 2;
+    CPU.BC.W    -= N;
+
+    while (N)
+    {
+        Src = MemoryMapR[CPU.HL.W>>14] + CPU.HL.W;
+        Dst = MemoryMapW[CPU.DE.W>>14] + CPU.DE.W;
+        if (Op == LDIR)
+        {
+            Len = MIN(N, MIN(0x4000 - (CPU.HL.W & 0x3FFF), 0x4000 - (CPU.DE.W & 0x3FFF)));
+            if ((Dst > Src) && (Dst < Src+Len)) for (i=0; i<Len; i++) Dst[i] = Src[i];
+            else memmove(Dst, Src, Len);
+            BULK_WRITTEN(CPU.DE.W, Len);
+            CPU.HL.W += Len;
+            CPU.DE.W += Len;
+        }
+        else // LDDR - Src and Dst are the top of the run
+        {
+            Len = MIN(N, MIN((CPU.HL.W & 0x3FFF) + 1, (CPU.DE.W & 0x3FFF) + 1));
+            if ((Dst < Src) && (Dst > Src-Len)) for (i=0; i<Len; i++) *Dst-- = *Src--;
+            else memmove(Dst-Len+1, Src-Len+1, Len);
+            BULK_WRITTEN((u32)CPU.DE.W-Len+1, Len);
+            CPU.HL.W -= Len;
+            CPU.DE.W -= Len;
+        }
+        N -= Len;
+    }
+
+    if (!CPU.BC.W) // Done - same exit as the last single pass
+    {
+        CPU.AF.B.l &= ~(N_FLAG|H_FLAG|P_FLAG);
+        CPU.TStates -= 4;
+        CPU.PC.W += 2;
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+// CPIR - memchr() through runs that don't cross a 16K page. Only the last byte compared has
+// any say in the flags (but for the carry which CPIR leaves alone).
+// ------------------------------------------------------------------------------------------
+static void BulkSearch(void)
+{
+    u32 Cost = Cycles[PFX_ED] + CyclesED[CPIR];
+    u32 N = MIN(RepeatPasses(Cost), CPU.BC.W);
+    u32 Done = 0, Len;
+    u8 *Src, *Hit = NULL;
+    byte I = 0, J;
+
+    if (!N) return;
+
+    while (!Hit && (Done < N))
+    {
+        Src = MemoryMapR[CPU.HL.W>>14] + CPU.HL.W;
+        Len = MIN(N - Done, 0x4000 - (CPU.HL.W & 0x3FFF));
+        Hit = memchr(Src, CPU.AF.B.h, Len);
+        if (Hit) Len = Hit - Src + 1;
+        I = Src[Len-1];
+        Done += Len;
+        CPU.HL.W += Len;
+    }
+
+    CPU.TStates += Done * Cost;
+    CPU.R       += Done * 2;
+    CPU.BC.W    -= Done;
+
+    J = CPU.AF.B.h - I;
+    CPU.AF.B.l =
+      N_FLAG|(CPU.AF.B.l&C_FLAG)|ZSTable[J]|
+      ((CPU.AF.B.h^I^J)&H_FLAG)|(CPU.BC.W? P_FLAG:0);
+
+    if (!CPU.BC.W || !J) // Done - same exit as the last single pass
+    {
+        CPU.TStates -= 4;
+        CPU.PC.W += 2;
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+// INIR/OTIR talk to a port on every pass so they still go one byte at a time, but the pass
+// loops inside the handler instead of going back through the fetch and decode. The opcode
+// is checked each time as an INIR can write over itself (and an OTIR can page it out).
+// ------------------------------------------------------------------------------------------
+INLINE u8 RepeatED(byte Op)
+{
+    if ((CPU.TStates >= RunLimit) || (RdZ80(CPU.PC.W) != PFX_ED) || (RdZ80(CPU.PC.W+1) != Op)) return 0;
+    CPU.PC.W    += 2;
+    CPU.TStates += Cycles[PFX_ED] + CyclesED[Op];
+    CPU.R       += 2;
+    return 1;
+}
+
+// ------------------------------------------------------------------------------
+// The opcode handlers below are shared by two dispatch engines. By default each
+// handler table is a plain switch(). With Z80_THREADED defined, the same Codes*.h
+// bodies are turned into labels (case X: becomes X:, break jumps to the end of
+// the table) and we jump straight to the handler through the label tables in
+// Dispatch.h - no range check and no jump-table indirection per instruction.
+// The keywords are only redefined while a Codes*.h file is being read (see
+// DispatchCodes.h) - the cases around them use Z80_CASE/Z80_DEFAULT/Z80_BREAK.
+// This relies on the Codes*.h bodies never using break/case for anything else.
+// ------------------------------------------------------------------------------
+#ifdef Z80_THREADED
+#include "Dispatch.h"
+#define Z80_DISPATCH(Labels)  static const void * const OpLabels[256] = {Labels}; goto *OpLabels[I];
+#define Z80_DISPATCH_END      Op_End:;
+#define Z80_CASE(Op)          Op
+#define Z80_DEFAULT           Op_Default
+#define Z80_BREAK             goto Op_End
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-label"
+#else
+#define Z80_DISPATCH(Labels)  switch(I)
+#define Z80_DISPATCH_END
+#define Z80_CASE(Op)          case Op
+#define Z80_DEFAULT           default
+#define Z80_BREAK             break
+#endif
+
 static void CodesCB(void)
 {
   register byte I;
@@ -469,12 +964,14 @@ static void CodesCB(void)
   /* R register incremented on each M1 cycle */
   INCR(1);
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_CB)
   {
-#include "CodesCB.h"
-    default:
+#define Z80_CODES "CodesCB.h"
+#include "DispatchCodes.h"
+    Z80_DEFAULT:
       if(CPU.TrapBadOps)  Trap_Bad_Ops(" CB ", I, CPU.PC.W-2);
   }
+  Z80_DISPATCH_END
 }
 
 ITCM_CODE static void CodesDDCB(void)
@@ -488,12 +985,14 @@ ITCM_CODE static void CodesDDCB(void)
   I=OpZ80(CPU.PC.W++);
   CPU.TStates += CyclesXXCB[I];
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_XXCB)
   {
-#include "CodesXCB.h"
-    default:
+#define Z80_CODES "CodesXCB.h"
+#include "DispatchCodes.h"
+    Z80_DEFAULT:
       if(CPU.TrapBadOps)  Trap_Bad_Ops("DDCB", I, CPU.PC.W-4);
   }
+  Z80_DISPATCH_END
 #undef XX
 }
 
@@ -508,12 +1007,14 @@ ITCM_CODE static void CodesFDCB(void)
   I=OpZ80(CPU.PC.W++);
   CPU.TStates += CyclesXXCB[I];
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_XXCB)
   {
-#include "CodesXCB.h"
-    default:
+#define Z80_CODES "CodesXCB.h"
+#include "DispatchCodes.h"
+    Z80_DEFAULT:
       if(CPU.TrapBadOps)  Trap_Bad_Ops("FDCB", I, CPU.PC.W-4);
   }
+  Z80_DISPATCH_END
 #undef XX
 }
 
@@ -529,14 +1030,16 @@ ITCM_CODE static void CodesED(void)
   /* R register incremented on each M1 cycle */
   INCR(1);
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_ED)
   {
-#include "CodesED.h"
-    case PFX_ED:
-      CPU.PC.W--;break;
-    default:
+#define Z80_CODES "CodesED.h"
+#include "DispatchCodes.h"
+    Z80_CASE(PFX_ED):
+      CPU.PC.W--;Z80_BREAK;
+    Z80_DEFAULT:
       if(CPU.TrapBadOps) Trap_Bad_Ops(" ED ", I, CPU.PC.W-4);
   }
+  Z80_DISPATCH_END
 }
 
 static void CodesDD(void)
@@ -552,17 +1055,19 @@ static void CodesDD(void)
   /* R register incremented on each M1 cycle */
   INCR(1);
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_XX)
   {
-#include "CodesXX.h"
-    case PFX_FD:
-    case PFX_DD:
-      CPU.PC.W--;break;
-    case PFX_CB:
-      CodesDDCB();break;
-    default:
+#define Z80_CODES "CodesXX.h"
+#include "DispatchCodes.h"
+    Z80_CASE(PFX_FD):
+    Z80_CASE(PFX_DD):
+      CPU.PC.W--;Z80_BREAK;
+    Z80_CASE(PFX_CB):
+      CodesDDCB();Z80_BREAK;
+    Z80_DEFAULT:
       if(CPU.TrapBadOps)  Trap_Bad_Ops(" DD ", I, CPU.PC.W-2);
   }
+  Z80_DISPATCH_END
 #undef XX
 }
 
@@ -579,10 +1084,11 @@ static void CodesFD(void)
   /* R register incremented on each M1 cycle */
   INCR(1);
 
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_XX)
   {
-#include "CodesXX.h"
-    case PFX_FD:
+#define Z80_CODES "CodesXX.h"
+#include "DispatchCodes.h"
+    Z80_CASE(PFX_FD):
         if (RdZ80(CPU.PC.W) == 0x70) // LD (IY+nn),B - Zone 0 command
         {
             DAN_Zone0 = CPU.BC.B.h;
@@ -609,14 +1115,15 @@ static void CodesFD(void)
                 }
             }
         }
-        CPU.PC.W--;break;
-    case PFX_DD:
-      CPU.PC.W--;break;
-    case PFX_CB:
-      CodesFDCB();break;
-    default:
+        CPU.PC.W--;Z80_BREAK;
+    Z80_CASE(PFX_DD):
+      CPU.PC.W--;Z80_BREAK;
+    Z80_CASE(PFX_CB):
+      CodesFDCB();Z80_BREAK;
+    Z80_DEFAULT:
         if(CPU.TrapBadOps)  Trap_Bad_Ops(" FD ", I, CPU.PC.W-2);
   }
+  Z80_DISPATCH_END
 #undef XX
 }
 
@@ -637,16 +1144,25 @@ void ExecOneInstruction(void)
 
   /* R register incremented on each M1 cycle */
   INCR(1);
+  LAZY_FLAGS(I);
+
+  /* Just the one opcode - no skipping ahead */
+  u32 Limit = RunLimit;
+  RunLimit = 0;
 
   /* Interpret opcode */
-  switch(I)
+  Z80_DISPATCH(Z80_LABELS_MAIN)
   {
-#include "Codes.h"
-    case PFX_CB: CodesCB();break;
-    case PFX_ED: CodesED();break;
-    case PFX_FD: CodesFD();break;
-    case PFX_DD: CodesDD();break;
+#define Z80_CODES "Codes.h"
+#include "DispatchCodes.h"
+    Z80_CASE(PFX_CB): CodesCB();Z80_BREAK;
+    Z80_CASE(PFX_ED): CodesED();Z80_BREAK;
+    Z80_CASE(PFX_FD): CodesFD();Z80_BREAK;
+    Z80_CASE(PFX_DD): CodesDD();Z80_BREAK;
   }
+  Z80_DISPATCH_END
+
+  RunLimit = Limit;
 }
 
 // ------------------------------------------------------------------------
@@ -665,6 +1181,81 @@ void EI_Enable(void)
    }
 }
 
+#ifdef Z80_BLOCK_CACHE
+// -------------------------------------------------------------------------------
+// Inside the block runner all opcode and operand fetches come from the block's
+// 16K map entry. Data reads (which may be anywhere) still go through the full map.
+// -------------------------------------------------------------------------------
+#undef RdZ80
+INLINE byte RdZ80(word A) {return MemoryMapR[(A)>>14][A];}
+#define OpZ80(A) Mem[A]
+
+ITCM_CODE void ExecZ80(u32 RunToCycles)
+{
+  register byte I;
+  register pair J;
+  register u8 *Mem;
+  register u32 Ops;
+  Z80Block *Block;
+
+  RunLimit = RunToCycles;
+  while (CPU.TStates < RunToCycles)
+  {
+      CPU.PC.W &= 0xFFFF; // The PC is allowed to run past 64K elsewhere but we index the map with it
+      Block = &BlockCache[CPU.PC.W & (Z80_BLOCKS-1)];
+      if ((Block->PC != CPU.PC.W) || (Block->Gen != BlockGen) || (Block->PageGen != BlockPageGen[CPU.PC.W>>8]))
+      {
+          DecodeBlock(Block);
+      }
+      else BlockHits++;
+
+      if (!Block->Ops) // Opcode straddles a page - just run it normally
+      {
+          ExecOneInstruction();
+          continue;
+      }
+
+      // ----------------------------------------------------------------------
+      // Not enough time left to run the block unchecked? Finish out the slice
+      // one opcode at a time so we stop on exactly the same opcode as always.
+      // ----------------------------------------------------------------------
+      if ((CPU.TStates + Block->Cycles) >= RunToCycles)
+      {
+          do ExecOneInstruction(); while (CPU.TStates < RunToCycles);
+          LAZY_DONE;
+          return;
+      }
+
+      Mem = MemoryMapR[CPU.PC.W>>14];
+      Ops = Block->Ops;
+      BlockStop = 0;
+      do
+      {
+          I=OpZ80(CPU.PC.W++);
+          CPU.TStates += Cycles[I];
+
+          /* R register incremented on each M1 cycle */
+          INCR(1);
+          LAZY_FLAGS(I);
+
+          /* Interpret opcode */
+          Z80_DISPATCH(Z80_LABELS_MAIN)
+          {
+#define Z80_CODES "Codes.h"
+#include "DispatchCodes.h"
+            Z80_CASE(PFX_CB): CodesCB();Z80_BREAK;
+            Z80_CASE(PFX_ED): CodesED();Z80_BREAK;
+            Z80_CASE(PFX_FD): CodesFD();Z80_BREAK;
+            Z80_CASE(PFX_DD): CodesDD();Z80_BREAK;
+          }
+          Z80_DISPATCH_END
+      } while (--Ops && !BlockStop);
+  }
+  LAZY_DONE;
+}
+
+#undef OpZ80
+#else
 // --------------------------------------------------------------------------------------------
 // The main Z80 instruction loop. We put this 15K chunk into fast memory as we want to make
 // the Z80 run as quickly as possible - this, along with the CRTC, is the heart of the system.
@@ -674,22 +1265,35 @@ ITCM_CODE void ExecZ80(u32 RunToCycles)
   register byte I;
   register pair J;
 
+  RunLimit = RunToCycles;
   while (CPU.TStates < RunToCycles)
   {
+      PROFILE_START;
       I=OpZ80(CPU.PC.W++);
       CPU.TStates += Cycles[I];
 
       /* R register incremented on each M1 cycle */
       INCR(1);
+      LAZY_FLAGS(I);
 
       /* Interpret opcode */
-      switch(I)
+      Z80_DISPATCH(Z80_LABELS_MAIN)
       {
-#include "Codes.h"
-        case PFX_CB: CodesCB();break;
-        case PFX_ED: CodesED();break;
-        case PFX_FD: CodesFD();break;
-        case PFX_DD: CodesDD();break;
+#define Z80_CODES "Codes.h"
+#include "DispatchCodes.h"
+        Z80_CASE(PFX_CB): CodesCB();Z80_BREAK;
+        Z80_CASE(PFX_ED): CodesED();Z80_BREAK;
+        Z80_CASE(PFX_FD): CodesFD();Z80_BREAK;
+        Z80_CASE(PFX_DD): CodesDD();Z80_BREAK;
       }
+      Z80_DISPATCH_END
+      PROFILE_END;
   }
+  LAZY_DONE;
 }
+
+#endif // Z80_BLOCK_CACHE
+
+#ifdef Z80_THREADED
+#pragma GCC diagnostic pop
+#endif
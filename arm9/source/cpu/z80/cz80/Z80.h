@@ -28,6 +28,14 @@ extern "C" {
 #endif
 
 //#define ZEXALL_TEST          /* Uncomment this to run the ZEXALL Z80 instruction test */
+//#define Z80_THREADED         /* Uncomment this to use computed-goto opcode dispatch  */
+//#define Z80_BLOCK_CACHE      /* Uncomment this to run the Z80 from decoded blocks    */
+//#define Z80_LAZY_FLAGS       /* Uncomment this to only work out F when it is read    */
+//#define Z80_PROFILE          /* Uncomment this to count executions/T-states per PC   */
+
+#ifdef Z80_PROFILE             /* The profiler counts in the plain loop...            */
+#undef Z80_BLOCK_CACHE
+#endif
 
                                /* Compilation options:       */
 #define LSB_FIRST              /* Compile for low-endian CPU */
@@ -125,6 +133,43 @@ void ResetZ80(register Z80 *R);
 void ExecZ80(u32 RunToCycles);
 #endif
 
+/** FlushZ80()/RemapZ80() ************************************/
+/** With Z80_BLOCK_CACHE these drop decoded code blocks.    **/
+/** Call FlushZ80() after RAM has been reloaded behind the  **/
+/** CPU's back and RemapZ80() when the memory map changes.  **/
+/*************************************************************/
+#ifdef Z80_BLOCK_CACHE
+void FlushZ80(void);
+void RemapZ80(void);
+extern u32 BlockHits, BlockMisses, BlockInvalidates;
+#else
+#define FlushZ80()
+#ifndef Z80_PROFILE
+#define RemapZ80()
+#endif
+#endif
+
+/** Profiler *************************************************/
+/** With Z80_PROFILE, ExecZ80() counts every opcode run and  **/
+/** the T-states it took per PC and per 16K bank mapped in  **/
+/** for reading. RemapZ80() keeps track of those banks.     **/
+/*************************************************************/
+#ifdef Z80_PROFILE
+#define PROFILE_BANKS 64          /* Last one catches overflow  */
+void RemapZ80(void);
+void ProfileResetZ80(void);
+extern u32 ProfileCount[0x10000];
+extern u32 ProfileCycles[0x10000];
+extern u32 ProfileBankCycles[PROFILE_BANKS];
+extern u8 *ProfileBankBase[PROFILE_BANKS];
+#endif
+
+/** IdleSkipped **********************************************/
+/** T-states that ExecZ80() skipped over with the CPU idle  **/
+/** in HALT, a JR to itself or a VSYNC polling loop.        **/
+/*************************************************************/
+extern u32 IdleSkipped;
+
 /** IntZ80() *************************************************/
 /** This function will generate interrupt of given vector.  **/
 /*************************************************************/
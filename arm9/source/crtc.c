@@ -71,6 +71,95 @@ u16 mode1_scale          __attribute__((section(".dtcm"))) = 0;    // For the Mo
 u8  mode2_offset         __attribute__((section(".dtcm"))) = 0;    // For the Mode 2 PAN/SCAN handling - offset position (horizontal)
 u16 mode2_scale          __attribute__((section(".dtcm"))) = 0;    // For the Mode 2 PAN/SCAN handling - scale (horizontal)
 
+// ------------------------------------------------------------------------------------------
+// Dirty line tracking. Every write to the screen's 16K (or 32K) of RAM stamps its 2K block
+// with the running scanline count - WrZ80() finds the stamp through ScreenDirtyW[] which is
+// pre-offset per Z80 page just like MemoryMapW[] so it can be indexed directly by A>>11.
+// Pages that don't write to the screen are NULL and writes to them stamp nothing. Each DS
+// line then remembers what it was last drawn from and when so that a line whose source,
+// mode, inks and offsets are all the same - and whose 2K block hasn't been written since -
+// is left alone. The DSi double-buffers so each of its two buffers keeps its own records.
+// ------------------------------------------------------------------------------------------
+u32 ScreenLine           __attribute__((section(".dtcm"))) = 1;    // Running scanline count - the write stamp
+u32 ScreenBlockStamp[32] __attribute__((section(".dtcm"))) = {0};  // Last write to each 2K block of the lower 64K
+u32 *ScreenDirtyW[4]     __attribute__((section(".dtcm"))) = {0};  // Per Z80 page - NULL unless it writes to the screen
+u8  *ScreenTracked       __attribute__((section(".dtcm"))) = 0;    // The screen page the stamps are following
+u8   ScreenTracked32K    __attribute__((section(".dtcm"))) = 0;    // And whether that was a 32K screen
+u32 inks_generation      __attribute__((section(".dtcm"))) = 0;    // Bumped with every ink (or border) change
+u32 lines_skipped        = 0;                                       // Lines left alone since the FPS was last shown
+u8  row_queued           __attribute__((section(".dtcm"))) = 0;    // Lines of this character row waiting to be drawn
+u8  row_per_line         __attribute__((section(".dtcm"))) = 0;    // This character row has gone back to line-by-line
+u8  crtc_skip_frame      __attribute__((section(".dtcm"))) = 0;    // Set to 1 to run this frame without drawing it (auto frame skip)
+
+typedef struct
+{
+    u32 stamp;      // ScreenLine when drawn - zero means the line must be drawn
+    u32 src;        // Screen RAM offset of the 2K block and the offset within it
+    u32 fmt;        // Mode, width, pan offset and HSYNC shift
+    u32 inks;       // inks_generation when drawn - a full word so it never comes back round
+} line_sig_t;
+
+line_sig_t line_sig[2][256];
+
+void crtc_redraw_all(void)
+{
+    memset(line_sig, 0x00, sizeof(line_sig));
+}
+
+// ----------------------------------------------------------------------------
+// Point the write stamps for each Z80 page that maps the screen for writing at
+// its blocks - the rest get NULL. Called whenever the memory map changes and
+// whenever the screen moves. Writes to a screen we weren't following weren't
+// stamped so all of its blocks are stamped now - its lines are drawn again.
+// ----------------------------------------------------------------------------
+void crtc_track_writes(void)
+{
+    u8 *screen = cpc_ScreenPage ? cpc_ScreenPage : RAM_Memory;
+    u8 *screen_end = screen + (b32K_Mode ? 0x8000 : 0x4000);
+    if (screen_end > RAM_Memory+0x10000) screen_end = RAM_Memory+0x10000;
+
+    if ((screen != ScreenTracked) || (b32K_Mode != ScreenTracked32K))
+    {
+        for (u32 b=(screen - RAM_Memory) >> 11; b < ((screen_end - RAM_Memory) >> 11); b++) ScreenBlockStamp[b] = ScreenLine;
+        ScreenTracked = screen;
+        ScreenTracked32K = b32K_Mode;
+    }
+
+    for (u8 p=0; p<4; p++)
+    {
+        u8 *base = MemoryMapW[p] + (p << 14);
+        if ((base >= screen) && (base < screen_end))
+            ScreenDirtyW[p] = ScreenBlockStamp + ((base - RAM_Memory) >> 11) - (p << 3);
+        else
+            ScreenDirtyW[p] = NULL;
+    }
+}
+
+// ---------------------------------------------------------------------------------
+// Returns 1 if this DS line already shows exactly what we are about to draw into
+// it - otherwise records what it is about to be drawn from and returns 0. The 32K
+// screen mode can run across two blocks of RAM so those lines are always drawn.
+// ---------------------------------------------------------------------------------
+static inline u8 crtc_line_unchanged(u8 *pixelPtr2K, u32 offset, u8 mode)
+{
+    line_sig_t *sig = &line_sig[isDSiMode() ? (emuTotFrames & 1) : 0][current_ds_line];
+
+    u8  pan = (mode == 1) ? mode1_offset : ((mode == 2) ? mode2_offset : 0);
+    u32 src = ((pixelPtr2K - RAM_Memory) << 15) | offset;
+    u32 fmt = (pan << 16) | (CRTC[1] << 8) | ((myConfig.panAndScan ? 1:0) << 3) | ((CRTC[3] & 1) << 2) | mode;
+
+    if (sig->stamp && (sig->src == src) && (sig->fmt == fmt) && (sig->inks == inks_generation) && !b32K_Mode)
+    {
+        if (ScreenBlockStamp[(pixelPtr2K - RAM_Memory) >> 11] < sig->stamp) return 1;
+    }
+
+    sig->stamp = ScreenLine;
+    sig->src   = src;
+    sig->fmt   = fmt;
+    sig->inks  = inks_generation;
+    return 0;
+}
+
 void crtc_reset(void)
 {
     HCC = 0;
@@ -90,6 +179,8 @@ void crtc_reset(void)
     mode2_scale = 0;
 
     current_ds_line = 0;
+    row_queued = 0;
+    row_per_line = 0;
     vsync_plus_two = 0;
     r12_screen_offset = 0;
     vsync_off_count = 0;
@@ -118,6 +209,7 @@ void crtc_reset(void)
 
     // Clear the screen
     memset((u8*)(0x06000000), 0x00, 0x20000);
+    crtc_redraw_all();
 }
 
 // ---------------------------------------------------------------------------------------------------------------
@@ -140,6 +232,117 @@ void crtc_r52_int(void)
     IntZ80(&CPU, CPU.IRequest);
 }
 
+// The line renderers themselves (and line_renderers[]) - kept apart for tools/crtc_render_bench.c
+#include "crtc_lines.h"
+
+// ------------------------------------------------------------------------------------------
+// Line buffering. With the RENDER option set to LINE BUFFER each line is drawn into one of
+// two cached line buffers and sent out to VRAM by DMA while the next line is drawn (or the
+// Z80 runs on). DMA can't reach DTCM so the buffers are in main RAM and are flushed from the
+// data cache first. Otherwise lines are drawn straight into VRAM as they always have been.
+// Either way the time it takes is counted on TIMER3 so the two can be compared in the
+// debugger. A wide CRTC[1] can draw up to 255 pixel pairs so the buffers are sized for that.
+// ------------------------------------------------------------------------------------------
+#define LINE_DMA_CHANNEL    2
+
+u32 line_buffer[2][512] __attribute__((aligned(32)));
+u8  line_buffer_idx = 0;
+u32 render_ticks = 0;       // TIMER3 ticks spent drawing lines since the FPS was last shown
+
+static inline void crtc_draw_line(line_renderer_t render, u32 *vidBufDS, u8 *pixelPtr2K, u32 offset)
+{
+    u16 start = TIMER3_DATA;
+
+    if (myGlobalConfig.lineBuffer)
+    {
+        u32 *buf = line_buffer[line_buffer_idx];
+        line_buffer_idx ^= 1;
+
+        u32 bytes = (render(buf, pixelPtr2K, offset) - buf) << 2;
+        DC_FlushRange(buf, bytes);
+        while (dmaBusy(LINE_DMA_CHANNEL));      // The previous line must be out before we send this one
+        dmaCopyWordsAsynch(LINE_DMA_CHANNEL, buf, vidBufDS, bytes);
+    }
+    else
+    {
+        render(vidBufDS, pixelPtr2K, offset);
+    }
+
+    render_ticks += (u16)(TIMER3_DATA - start);
+}
+
+// The frame isn't complete until the last line has been sent out
+static inline void crtc_line_dma_wait(void)
+{
+    if (myGlobalConfig.lineBuffer)
+    {
+        while (dmaBusy(LINE_DMA_CHANNEL));
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+// Character row batching. While the CRTC registers, mode and inks hold steady across a
+// character row, its display lines are only queued up as the raster passes them and are
+// then all drawn together when the row ends - the renderer and its pre-inked table stay
+// in the cache instead of being pushed out by a scanline of Z80 between every line. A
+// register or ink write mid-row draws whatever is queued right away (with the settings
+// those lines were shown with) and the rest of that row is drawn line by line - as it is
+// when a queued line's 2K block of screen memory gets written before the row is done.
+// ------------------------------------------------------------------------------------------
+typedef struct
+{
+    line_renderer_t render;
+    u32 *vidBufDS;
+    u8  *pixelPtr2K;
+    u32  offset;
+    u32  stamp;     // ScreenLine when queued
+} row_line_t;
+
+row_line_t row_queue[32];   // CRTC[9] allows up to 32 lines in a row
+
+ITCM_CODE void crtc_flush_row(void)
+{
+    for (u8 i=0; i<row_queued; i++)
+    {
+        row_line_t *q = &row_queue[i];
+        crtc_draw_line(q->render, q->vidBufDS, q->pixelPtr2K, q->offset);
+    }
+    row_queued = 0;
+}
+
+// Called ahead of any CRTC or Gate Array write that changes how the screen is drawn
+ITCM_CODE void crtc_row_interrupted(void)
+{
+    crtc_flush_row();
+    row_per_line = 1;
+}
+
+static inline void crtc_queue_line(line_renderer_t render, u32 *vidBufDS, u8 *pixelPtr2K, u32 offset)
+{
+    if (row_per_line || b32K_Mode) // The 32K screen spans two blocks - just draw it now
+    {
+        crtc_draw_line(render, vidBufDS, pixelPtr2K, offset);
+        return;
+    }
+
+    for (u8 i=0; i<row_queued; i++)
+    {
+        if (ScreenBlockStamp[(row_queue[i].pixelPtr2K - RAM_Memory) >> 11] >= row_queue[i].stamp)
+        {
+            crtc_row_interrupted(); // Screen memory under a queued line has been written
+            crtc_draw_line(render, vidBufDS, pixelPtr2K, offset);
+            return;
+        }
+    }
+
+    row_line_t *q = &row_queue[row_queued++];
+    q->render     = render;
+    q->vidBufDS   = vidBufDS;
+    q->pixelPtr2K = pixelPtr2K;
+    q->offset     = offset;
+    q->stamp      = ScreenLine;
+}
+
 // ------------------------------------------------------------------------------------
 // Only when we start to render a new frame do we latch the screen memory and offsets
 //
@@ -172,6 +375,26 @@ void crtc_new_frame_coming_up(void)
     // A rare game or the occasional demo will make use of 32K mode
     // -------------------------------------------------------------
     b32K_Mode = ((CRTC[12] & 0xC) == 0xC) ? 1:0;
+
+    // Only the screen's own pages stamp their writes - follow it if it moved
+    if ((cpc_ScreenPage != ScreenTracked) || (b32K_Mode != ScreenTracked32K)) crtc_track_writes();
+}
+
+// ----------------------------------------------------------------------------
+// Does the coming HSYNC have to happen on time? Only if it draws screen pixels
+// or changes something the CPU can see - VSYNC in PPI port B or the R52 count.
+// Anything else (border lines, lines off the LCD, frames being skipped) can be
+// caught up at the end of the line - see the scheduler in amstrad.c. The two
+// interrupts have events of their own. Saying 'yes' too often only costs a stop.
+// ----------------------------------------------------------------------------
+ITCM_CODE u8 crtc_hsync_needed(void)
+{
+    if (((VLC + 1) & 0x1F) >= (CRTC[9]+1)) return 1;   // New character row - VSYNC and the display may switch
+    if (vsync_off_count == 1) return 1;                 // VSYNC ends on this line
+    if (CPU.IRequest != INT_NONE) return 1;             // An EI would clear R52 bit 5 under the line's count
+    if (crtc_skip_frame) return 0;                      // Nothing is drawn this frame
+
+    return (DISPEN || VTAC) && ((current_ds_line & 0xFFFFFF00) == 0);
 }
 
 // ----------------------------------------------------------------------------
@@ -196,14 +419,17 @@ ITCM_CODE u8 crtc_render_screen_line(void)
     u32 *vidBufDS;              // This is where we draw to on the DS LCD
 
     raster_counter++;
+    ScreenLine++;       // Writes from here on are after this line was drawn
 
     // -------------------------------------------------
     // See if the inks have changed since the last call.
     // -------------------------------------------------
     if (inks_changed)
     {
-        compute_pre_inked(RMR & 0x03);
+        crtc_flush_row();   // Anything still queued was shown with the old inks
+        update_pre_inked(RMR & 0x03);
         inks_changed = 0;
+        inks_generation++;
     }
 
     // -------------------------------------------
@@ -259,6 +485,9 @@ ITCM_CODE u8 crtc_render_screen_line(void)
     {
         VLC = 0;                // Reset counter - build up the next character line
 
+        crtc_flush_row();       // Draw the character row we just finished
+        row_per_line = 0;
+
         if (myConfig.crtcDriver == CRTC_DRV_ADVANCED) // 'ADVANCED' Driver
         {
             if (!VTAC) // If we are in the 'extra counting' of an adjustment, we no longer increment VCC
@@ -421,145 +650,15 @@ ITCM_CODE u8 crtc_render_screen_line(void)
             }
 
             offset &= 0x47FF;  // Wrap is on 2K boundary
-
             // -------------------------------------------------------------------------------------
             // With 2, 4 or 8 pixels per byte, there are always 80 bytes of horizontal screen data
             // -------------------------------------------------------------------------------------
-            if ((RMR & 0x03) == 0x00) // Mode 0  (160x256)
-            {
-                last_frame_crtc1 = CRTC[1];
-                for (int x=0; x<CRTC[1]; x++)
-                {
-                    *vidBufDS++ = pre_inked_mode0[pixelPtr2K[offset++]];    // Fast draw pixel with pre-rendered lookup
-                    *vidBufDS++ = pre_inked_mode0[pixelPtr2K[offset++]];    // Fast draw pixel with pre-rendered lookup
-                    // -------------------------------------------------------------
-                    // For the rare 32K video buffer - used by a few amazing games
-                    // -------------------------------------------------------------
-                    if (b32K_Mode)
-                    {
-                        if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                    }
-
-                    offset &= 0x47FF;  // Wrap is always at the 2K boundary
-                }
-
-                // Draw border out to at least 320 pixels + 64 for overscan
-                for (u16 i=CRTC[1]; i<48;i++)
-                {
-                    *vidBufDS++ = border_color;
-                    *vidBufDS++ = border_color;
-                }
-            }
-            else if ((RMR & 0x03) == 0x01) // Mode 1 (320x256)
-            {
-                last_frame_mode1++;
-                if (myConfig.panAndScan != 0) // Pan and Scan enabled?
-                {
-                    if (mode1_offset)
-                    {
-                        offset = (offset+mode1_offset) & 0x47FF;
-                        // -------------------------------------------------------------
-                        // For the rare 32K video buffer - used by a few amazing games
-                        // -------------------------------------------------------------
-                        if (b32K_Mode)
-                        {
-                            if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                        }
-                        offset &= 0x47FF;                                  // Wrap is always at the 2K boundary
-                    }
-                }
-
-                last_frame_crtc1 = CRTC[1];
-                for (int x=0; x<(CRTC[1]); x++)
-                {
-                    *vidBufDS++ = pre_inked_mode1[pixelPtr2K[offset++]];  // Fast draw pixel with pre-rendered lookup
-                    *vidBufDS++ = pre_inked_mode1[pixelPtr2K[offset++]];  // Fast draw pixel with pre-rendered lookup
-                    // -------------------------------------------------------------
-                    // For the rare 32K video buffer - used by a few amazing games
-                    // -------------------------------------------------------------
-                    if (b32K_Mode)
-                    {
-                        if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                    }
-                    offset &= 0x47FF;  // Wrap is always at the 2K boundary
-                }
+            u8 mode = RMR & 0x03;
+            if (mode == 0x01) last_frame_mode1++;
+            if (mode == 0x02) last_frame_mode2++;
+            if (mode <= 0x01) last_frame_crtc1 = CRTC[1];
 
-                // Draw border out to at least 320 pixels + 64 for overscan
-                for (u16 i=CRTC[1]; i<48;i++)
-                {
-                    *vidBufDS++ = border_color;
-                    *vidBufDS++ = border_color;
-                }
-            }
-            else if ((RMR & 0x03) == 0x02) // Mode 2 (640x256)
-            {
-                last_frame_mode2++;
-                if (myConfig.panAndScan == 0) // Show compressed?
-                {
-                    u8 limit = (CRTC[1] <= 48) ? CRTC[1] : 48;
-                    for (int x=0; x<limit; x++)    // Best we can do is render 512 pixels
-                    {
-                        *vidBufDS++ = pre_inked_mode2c[pixelPtr2K[offset]];  // Fast draw pixel with pre-rendered lookup
-                        offset++;
-                        *vidBufDS++ = pre_inked_mode2c[pixelPtr2K[offset]];  // Fast draw pixel with pre-rendered lookup
-                        offset++;
-                        // -------------------------------------------------------------
-                        // For the rare 32K video buffer - used by a few amazing games
-                        // -------------------------------------------------------------
-                        if (b32K_Mode)
-                        {
-                            if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                        }
-                        offset &= 0x47FF;  // Wrap is always at the 2K boundary
-                    }
-
-                    // Render the border out to the full 512 pixels for the DS (that's all we have)
-                    for (int x=limit; x<48; x++)
-                    {
-                        *vidBufDS++ = border_color;
-                        *vidBufDS++ = border_color;
-                    }
-                }
-                else
-                {
-                    if (mode2_offset)
-                    {
-                        offset = (offset+mode2_offset) & 0x47FF;
-                        // -------------------------------------------------------------
-                        // For the rare 32K video buffer - used by a few amazing games
-                        // -------------------------------------------------------------
-                        if (b32K_Mode)
-                        {
-                            if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                        }
-                        offset &= 0x47FF;                                  // Wrap is always at the 2K boundary
-                    }
-
-                    for (int x=0; x<40; x++)    // Best we can do is show 320 pixels
-                    {
-                        if (x+mode2_offset < (CRTC[1]*2))
-                        {
-                            *vidBufDS++ = pre_inked_mode2a[pixelPtr2K[offset]];  // Fast draw pixel with pre-rendered lookup
-                            *vidBufDS++ = pre_inked_mode2b[pixelPtr2K[offset]];  // Fast draw pixel with pre-rendered lookup
-                            offset++;
-                            // -------------------------------------------------------------
-                            // For the rare 32K video buffer - used by a few amazing games
-                            // -------------------------------------------------------------
-                            if (b32K_Mode)
-                            {
-                                if ((offset&0xFFF) >= 0x800) offset += 0x4000; // We address into the next bank of memory
-                            }
-                            offset &= 0x47FF;  // Wrap is always at the 2K boundary
-                        }
-                        else
-                        {
-                            *vidBufDS++ = border_color;
-                            *vidBufDS++ = border_color;
-                        }
-                    }
-                }
-            }
-            else // Mode 3 never used... hopefully!
+            if (mode == 0x03) // Mode 3 never used... hopefully!
             {
                 // -------------------------------------------------------------------
                 // Mode 3 is an 'unofficial' mode that is a consequence / side-effect
@@ -569,9 +668,22 @@ ITCM_CODE u8 crtc_render_screen_line(void)
                 // -------------------------------------------------------------------
                 DY++;
             }
+            else if (crtc_skip_frame)
+            {
+                // Frame skip - the counters above are all this frame needs as it won't be shown
+            }
+            else if (crtc_line_unchanged(pixelPtr2K, offset, mode)) // Nothing on this line has changed
+            {
+                lines_skipped++;
+            }
+            else
+            {
+                crtc_queue_line(line_renderers[mode][myConfig.panAndScan ? 1:0][b32K_Mode], vidBufDS, pixelPtr2K, offset);
+            }
         }
-        else // Display not enabled - render border
+        else if (!crtc_skip_frame) // Display not enabled - render border
         {
+            line_sig[isDSiMode() ? (emuTotFrames & 1) : 0][current_ds_line].stamp = 0;
             for (int x=0; x<(isDSiMode() ? 64:50); x++) // Draw out to the 512 pixel mark on DSi... DS-Lite to 400.
             {
                 *vidBufDS++ = border_color;
@@ -590,5 +702,11 @@ ITCM_CODE u8 crtc_render_screen_line(void)
 
     current_ds_line++;
 
+    if (vSyncDS) // The frame must be complete before it is shown
+    {
+        crtc_flush_row();
+        crtc_line_dma_wait();
+    }
+
     return vSyncDS;
 }
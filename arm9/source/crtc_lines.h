@@ -0,0 +1,139 @@
+// =====================================================================================
+// Copyright (c) 2025 Dave Bernazzani (wavemotion-dave)
+//
+// Copying and distribution of this emulator, its source code and associated
+// readme files, with or without modification, are permitted in any medium without
+// royalty provided this copyright notice is used and wavemotion-dave and Marat
+// Fayzullin (Z80 core) are thanked profusely.
+//
+// The SugarDS emulator is offered as-is, without any warranty. Please see readme.md
+// =====================================================================================
+
+// ------------------------------------------------------------------------------------------
+// This is part of crtc.c and is included only from there (after SugarDS.h and AmsUtils.h)
+// and from tools/crtc_render_bench.c - which checks these renderers pixel for pixel against
+// the old byte-at-a-time loop on the PC. Keep anything DS-only out of it.
+// ------------------------------------------------------------------------------------------
+
+// ------------------------------------------------------------------------------------------
+// The line renderers. Screen memory is read in runs up to the next 2K wrap point so the
+// inner loops do nothing but look up pre-inked pixels - one renderer for each mode, 32K
+// wrap and pan-and-scan combination, picked per line from line_renderers[]. All of them
+// wrap exactly as the CRTC addressing does: mode 0, mode 1 and the compressed mode 2 check
+// the wrap after every pair of bytes (so an odd pan offset reads one byte over the 2K edge
+// before wrapping) while the mode 2 pan-and-scan checks after every byte. With the 32K
+// screen, a wrap flips between the two 16K halves rather than back to the same 2K block.
+// ------------------------------------------------------------------------------------------
+typedef u32 *(*line_renderer_t)(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset);   // Returns the end of the line drawn
+
+static inline u32 *crtc_draw_run(u32 *vidBufDS, u8 *src, u32 pairs, u32 *table)
+{
+    while (pairs >= 4)
+    {
+        *vidBufDS++ = table[*src++];        // Fast draw pixel with pre-rendered lookup
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+        pairs -= 4;
+    }
+    while (pairs--)
+    {
+        *vidBufDS++ = table[*src++];
+        *vidBufDS++ = table[*src++];
+    }
+    return vidBufDS;
+}
+
+// A line is at most 255 pairs - 510 bytes - so it can only ever cross one 2K wrap
+static inline u32 *crtc_draw_pairs(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset, u32 pairs, u32 *table, const u8 wrap32)
+{
+    u32 run = (0x800 - (offset & 0x7FF) + 1) >> 1;     // Pairs up to (and across) the 2K wrap
+    if (run >= pairs) return crtc_draw_run(vidBufDS, pixelPtr2K + offset, pairs, table);
+
+    vidBufDS = crtc_draw_run(vidBufDS, pixelPtr2K + offset, run, table);
+    offset = (offset + (run << 1)) - 0x800;            // Wrap is always at the 2K boundary
+    if (wrap32) offset ^= 0x4000;                      // For the rare 32K video buffer - into the other 16K
+    return crtc_draw_run(vidBufDS, pixelPtr2K + offset, pairs - run, table);
+}
+
+static inline u32 *crtc_draw_border(u32 *vidBufDS, int count)
+{
+    while (count-- > 0)
+    {
+        *vidBufDS++ = border_color;
+        *vidBufDS++ = border_color;
+    }
+    return vidBufDS;
+}
+
+// Mode 0 (160x256) and Mode 1 (320x256) - border out to at least 320 pixels + 64 for overscan
+#define MODE01_RENDERER(NAME, TABLE, PAN, WRAP32)                                       \
+static u32 *NAME(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset)                             \
+{                                                                                       \
+    if (PAN) offset = (offset + mode1_offset) & 0x47FF;                                 \
+    vidBufDS = crtc_draw_pairs(vidBufDS, pixelPtr2K, offset, CRTC[1], TABLE, WRAP32);   \
+    return crtc_draw_border(vidBufDS, 48 - CRTC[1]);                                    \
+}
+
+// Mode 2 (640x256) compressed - best we can do is render 512 pixels out of the 640
+#define MODE2C_RENDERER(NAME, WRAP32)                                                   \
+static u32 *NAME(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset)                             \
+{                                                                                       \
+    u32 limit = (CRTC[1] <= 48) ? CRTC[1] : 48;                                         \
+    vidBufDS = crtc_draw_pairs(vidBufDS, pixelPtr2K, offset, limit, pre_inked_mode2c, WRAP32); \
+    return crtc_draw_border(vidBufDS, 48 - limit);                                      \
+}
+
+// Mode 2 (640x256) pan-and-scan - best we can do is show 320 of the 640 pixels
+static inline u32 *crtc_draw_mode2_run(u32 *vidBufDS, u8 *src, u32 count)
+{
+    while (count--)
+    {
+        *vidBufDS++ = pre_inked_mode2a[*src];
+        *vidBufDS++ = pre_inked_mode2b[*src++];
+    }
+    return vidBufDS;
+}
+
+#define MODE2P_RENDERER(NAME, WRAP32)                                                   \
+static u32 *NAME(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset)                             \
+{                                                                                       \
+    int count = (CRTC[1]*2) - mode2_offset;                                             \
+    if (count < 0) count = 0;                                                           \
+    if (count > 40) count = 40;                                                         \
+    int border = 40 - count;                                                            \
+    offset = (offset + mode2_offset) & 0x47FF;                                          \
+    int run = 0x800 - (offset & 0x7FF);             /* Bytes up to the 2K wrap */       \
+    if (run >= count) vidBufDS = crtc_draw_mode2_run(vidBufDS, pixelPtr2K + offset, count); \
+    else                                                                                \
+    {                                                                                   \
+        vidBufDS = crtc_draw_mode2_run(vidBufDS, pixelPtr2K + offset, run);             \
+        offset = (offset & 0x4000) ^ (WRAP32 ? 0x4000 : 0);                             \
+        vidBufDS = crtc_draw_mode2_run(vidBufDS, pixelPtr2K + offset, count - run);     \
+    }                                                                                   \
+    return crtc_draw_border(vidBufDS, border);                                          \
+}
+
+// The everyday renderers get the fast memory - the rest are not used often enough to soak it up
+ITCM_CODE MODE01_RENDERER(render_mode0,         pre_inked_mode0, 0, 0)
+ITCM_CODE MODE01_RENDERER(render_mode1,         pre_inked_mode1, 0, 0)
+ITCM_CODE MODE01_RENDERER(render_mode1_pan,     pre_inked_mode1, 1, 0)
+          MODE01_RENDERER(render_mode0_32k,     pre_inked_mode0, 0, 1)
+          MODE01_RENDERER(render_mode1_32k,     pre_inked_mode1, 0, 1)
+          MODE01_RENDERER(render_mode1_pan_32k, pre_inked_mode1, 1, 1)
+          MODE2C_RENDERER(render_mode2,         0)
+          MODE2C_RENDERER(render_mode2_32k,     1)
+          MODE2P_RENDERER(render_mode2_pan,     0)
+          MODE2P_RENDERER(render_mode2_pan_32k, 1)
+
+// Indexed by [mode][pan-and-scan][32K screen] - there is no mode 3 renderer
+line_renderer_t line_renderers[3][2][2] =
+{
+    {{render_mode0, render_mode0_32k}, {render_mode0,     render_mode0_32k}},
+    {{render_mode1, render_mode1_32k}, {render_mode1_pan, render_mode1_pan_32k}},
+    {{render_mode2, render_mode2_32k}, {render_mode2_pan, render_mode2_pan_32k}},
+};
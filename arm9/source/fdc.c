@@ -32,6 +32,7 @@
 #include  <nds.h>
 #include "SugarDS.h"
 #include "fdc.h"
+#include "arena.h"
 
 // Status Bits
 #define STATUS_CB       0x10
@@ -60,8 +61,6 @@ typedef int ( * pfctFDC )( int );
 
 FDC_t fdc;
 
-u8 DISK_IMAGE_BUFFER[896*1024]; // Big enough for any 3" or 3.5" disk format
-
 int SeekSector( int *pos )
 {
     floppy_sound = 2;
@@ -773,15 +772,16 @@ void ReadDiskMem(u8 *rom, u32 romsize)
     // --------------------------
     if (fdc.Image!=0) fdc.Image = 0;
 
-    // ----------------------------------------------------
-    // And read in the new disk image into the FDC buffers
-    // ----------------------------------------------------
+    // ---------------------------------------------------------------
+    // The FDC works on the disk image right where it was loaded - only
+    // the 256 byte header is copied out. Writes go to the same buffer
+    // and the dirty 4K blocks are written back to the .dsk from there.
+    // ---------------------------------------------------------------
     fdc.disk_size=romsize-sizeof(fdc.DiskInfo);
 
-    fdc.ImgDsk=(u8*)DISK_IMAGE_BUFFER;
-
     memcpy(&fdc.DiskInfo, rom, sizeof(fdc.DiskInfo));
-    memcpy(fdc.ImgDsk, rom+sizeof(fdc.DiskInfo), fdc.disk_size);
+    fdc.ImgDsk=rom+sizeof(fdc.DiskInfo);
+    arena_use(ARENA_DISK, fdc.disk_size);
 
     // ---------------------------------------------------------------------------
     // Setting ReadyIn here will mark the status as 'Not Ready' for 25 frames
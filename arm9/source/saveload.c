@@ -24,6 +24,7 @@
 #include "printf.h"
 #include "fdc.h"
 #include "lzav.h"
+#include "arena.h"
 
 #define SUGAR_SAVE_VER   0x0005     // Change this if the basic format of the .SAV file changes. Invalidates older .sav files.
 
@@ -35,10 +36,6 @@ u8  spare[256] = {0x00};            // We keep some spare bytes so we can use th
 static char szLoadFile[256];        // We build the filename out of the base filename and tack on .sav, .ee, etc.
 static char tmpStr[32];             // For various screen status strings
 
-u8 CompressBuffer[150*1024];        // Big enough to handle compression of even full 128K games
-
-extern u8 DSi_ExpandedRAM[];
-
 void amstradSaveState()
 {
   size_t retVal;
@@ -154,60 +151,41 @@ void amstradSaveState()
     // still quite fast for such small memory buffers and often shrinks
     // 128K of memory down to less than 32K (or 64K at worst).
     // -------------------------------------------------------------------
+    // The compression scratch is borrowed from the memory arena just while we need it
     int max_len = lzav_compress_bound_hi( 0x20000 );
-    int comp_len = lzav_compress_hi( RAM_Memory, CompressBuffer, 0x20000, max_len );
+    u8 *CompressBuffer = arena_scratch(max_len);
+    int comp_len = 0;
+    if (CompressBuffer) comp_len = lzav_compress_hi( RAM_Memory, CompressBuffer, 0x20000, max_len );
+    else retVal = 0;    // No memory to compress into
 
     if (retVal) retVal = fwrite(&comp_len,          sizeof(comp_len), 1, handle);
-    if (retVal) retVal = fwrite(&CompressBuffer,    comp_len,         1, handle);
+    if (retVal) retVal = fwrite(CompressBuffer,     comp_len,         1, handle);
+    arena_scratch_done();
 
     if (ram_highwater) // If we used more than one extra 64K bank... we need to save those
     {
         u8 *upper_ram_block = 0;
         for (u8 block=1; block<=ram_highwater; block++)
         {
-            if (isDSiMode())
-            {
-                switch (block)
-                {
-                    case 1:  upper_ram_block = DSi_ExpandedRAM+0x00000; break;
-                    case 2:  upper_ram_block = DSi_ExpandedRAM+0x10000; break;
-                    case 3:  upper_ram_block = DSi_ExpandedRAM+0x20000; break;
-                    case 4:  upper_ram_block = DSi_ExpandedRAM+0x30000; break;
-                    case 5:  upper_ram_block = DSi_ExpandedRAM+0x40000; break;
-                    case 6:  upper_ram_block = DSi_ExpandedRAM+0x50000; break;
-                    case 7:  upper_ram_block = DSi_ExpandedRAM+0x60000; break;
-                    case 8:  upper_ram_block = DSi_ExpandedRAM+0x70000; break;
-                    case 9:  upper_ram_block = DSi_ExpandedRAM+0x80000; break;
-                    case 10: upper_ram_block = DSi_ExpandedRAM+0x90000; break;
-                    case 11: upper_ram_block = DSi_ExpandedRAM+0xA0000; break;
-                    case 12: upper_ram_block = DSi_ExpandedRAM+0xB0000; break;
-                    case 13: upper_ram_block = DSi_ExpandedRAM+0xC0000; break;
-                    case 14: upper_ram_block = DSi_ExpandedRAM+0xD0000; break;
-                    case 15: upper_ram_block = DSi_ExpandedRAM+0xE0000; break;
-                }
-            }
-            else
-            {
-                switch (block)
-                {
-                    case 1: upper_ram_block = ROM_Memory+0xF0000; break;
-                    case 2: upper_ram_block = ROM_Memory+0xE0000; break;
-                    case 3: upper_ram_block = ROM_Memory+0xD0000; break;
-                    case 4: upper_ram_block = ROM_Memory+0xC0000; break;
-                    case 5: upper_ram_block = ROM_Memory+0xB0000; break;
-                    case 6: upper_ram_block = ROM_Memory+0xA0000; break;
-                    case 7: upper_ram_block = ROM_Memory+0x90000; break;
-                }
-            }
+            // Expansion banks come from the bank manager (the DS-Lite/Phat wraps at 512K)
+            u8 bank = isDSiMode() ? block : (block & 7);
+            upper_ram_block = bank ? ram_bank(bank) : (RAM_Memory+0x10000);
+            if (!upper_ram_block) retVal = 0; // No memory to bring it in
 
             int max_len = lzav_compress_bound_hi( 0x10000 );
-            int comp_len = lzav_compress_hi( upper_ram_block, CompressBuffer, 0x10000, max_len );
+            u8 *CompressBuffer = retVal ? arena_scratch(max_len) : 0;
+            int comp_len = 0;
+            if (CompressBuffer) comp_len = lzav_compress_hi( upper_ram_block, CompressBuffer, 0x10000, max_len );
+            else retVal = 0;
 
             if (retVal) retVal = fwrite(&comp_len,          sizeof(comp_len), 1, handle);
-            if (retVal) retVal = fwrite(&CompressBuffer,    comp_len,         1, handle);
+            if (retVal) retVal = fwrite(CompressBuffer,     comp_len,         1, handle);
+            arena_scratch_done();
         }
     }
 
+    ConfigureMemory(); // Saving may have moved which expansion banks are resident
+
     strcpy(tmpStr, (retVal ? "OK ":"ERR"));
     DSPrint(27,0,0,tmpStr);
     WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;WAITVBL;
@@ -274,7 +252,7 @@ void amstradLoadState()
 
             // Read the FDC floppy struct
             if (retVal) retVal = fread(&fdc, sizeof(fdc), 1, handle);
-            if (fdc.ImgDsk) fdc.ImgDsk = DISK_IMAGE_BUFFER;
+            if (fdc.ImgDsk) fdc.ImgDsk = ROM_Memory + sizeof(fdc.DiskInfo); // The disk image is used in place
 
             // Read CRTC info
             if (retVal) retVal = fread(CRTC,  sizeof(CRTC), 1, handle);
@@ -342,66 +320,49 @@ void amstradLoadState()
             if (retVal) retVal = fread(&ram_highwater,     sizeof(ram_highwater),      1, handle);
 
             // Load Z80 Memory Map... all 128K of it!
+            // A length no compressor could have written means a damaged save - don't trust it
             int comp_len = 0;
             if (retVal) retVal = fread(&comp_len,          sizeof(comp_len), 1, handle);
-            if (retVal) retVal = fread(&CompressBuffer,    comp_len,         1, handle);
+            if ((comp_len <= 0) || (comp_len > lzav_compress_bound_hi( 0x20000 ))) retVal = 0;
+            u8 *CompressBuffer = retVal ? arena_scratch(comp_len) : 0;
+            if (!CompressBuffer) retVal = 0;
+            if (retVal) retVal = fread(CompressBuffer,     comp_len,         1, handle);
 
             // ------------------------------------------------------------------
             // Decompress the previously compressed RAM and put it back into the
             // right memory location... this is quite fast all things considered.
             // ------------------------------------------------------------------
-            (void)lzav_decompress( CompressBuffer, RAM_Memory, comp_len, 0x20000 );
+            if (retVal && (lzav_decompress( CompressBuffer, RAM_Memory, comp_len, 0x20000 ) < 0)) retVal = 0;
+            arena_scratch_done();
 
+            ram_bank_reset(); // Any expansion banks not in the save are back to zero
             if (ram_highwater) // If we used more than one extra 64K bank... we need to save those
             {
                 u8 *upper_ram_block = 0;
                 for (u8 block=1; block<=ram_highwater; block++)
                 {
+                    // Expansion banks come from the bank manager (the DS-Lite/Phat wraps at 512K)
+                    u8 bank = isDSiMode() ? block : (block & 7);
+                    upper_ram_block = bank ? ram_bank(bank) : (RAM_Memory+0x10000);
+                    if (!upper_ram_block) retVal = 0; // No memory to bring it in
+
                     int comp_len = 0;
                     if (retVal) retVal = fread(&comp_len,          sizeof(comp_len), 1, handle);
-                    if (retVal) retVal = fread(&CompressBuffer,    comp_len,         1, handle);
-
-                    if (isDSiMode())
-                    {
-                        switch (block)
-                        {
-                            case 1:  upper_ram_block = DSi_ExpandedRAM+0x00000; break;
-                            case 2:  upper_ram_block = DSi_ExpandedRAM+0x10000; break;
-                            case 3:  upper_ram_block = DSi_ExpandedRAM+0x20000; break;
-                            case 4:  upper_ram_block = DSi_ExpandedRAM+0x30000; break;
-                            case 5:  upper_ram_block = DSi_ExpandedRAM+0x40000; break;
-                            case 6:  upper_ram_block = DSi_ExpandedRAM+0x50000; break;
-                            case 7:  upper_ram_block = DSi_ExpandedRAM+0x60000; break;
-                            case 8:  upper_ram_block = DSi_ExpandedRAM+0x70000; break;
-                            case 9:  upper_ram_block = DSi_ExpandedRAM+0x80000; break;
-                            case 10: upper_ram_block = DSi_ExpandedRAM+0x90000; break;
-                            case 11: upper_ram_block = DSi_ExpandedRAM+0xA0000; break;
-                            case 12: upper_ram_block = DSi_ExpandedRAM+0xB0000; break;
-                            case 13: upper_ram_block = DSi_ExpandedRAM+0xC0000; break;
-                            case 14: upper_ram_block = DSi_ExpandedRAM+0xD0000; break;
-                            case 15: upper_ram_block = DSi_ExpandedRAM+0xE0000; break;
-                        }
-                    }
-                    else
-                    {
-                        switch (block)
-                        {
-                            case 1: upper_ram_block = ROM_Memory+0xF0000; break;
-                            case 2: upper_ram_block = ROM_Memory+0xE0000; break;
-                            case 3: upper_ram_block = ROM_Memory+0xD0000; break;
-                            case 4: upper_ram_block = ROM_Memory+0xC0000; break;
-                            case 5: upper_ram_block = ROM_Memory+0xB0000; break;
-                            case 6: upper_ram_block = ROM_Memory+0xA0000; break;
-                            case 7: upper_ram_block = ROM_Memory+0x90000; break;
-                        }
-                    }
-
-                    (void)lzav_decompress( CompressBuffer, upper_ram_block, comp_len, 0x10000 );
+                    if ((comp_len <= 0) || (comp_len > lzav_compress_bound_hi( 0x10000 ))) retVal = 0;
+                    u8 *CompressBuffer = retVal ? arena_scratch(comp_len) : 0;
+                    if (!CompressBuffer) retVal = 0;
+                    if (retVal) retVal = fread(CompressBuffer,     comp_len,         1, handle);
+
+                    if (retVal && (lzav_decompress( CompressBuffer, upper_ram_block, comp_len, 0x10000 ) < 0)) retVal = 0;
+                    arena_scratch_done();
                 }
             }
 
             // And put the memory pointers back in place...
             ConfigureMemory();
+            FlushZ80();
+            crtc_redraw_all();
+            sched_reset();
             compute_pre_inked(0);
             compute_pre_inked(1);
             compute_pre_inked(2);
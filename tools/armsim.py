@@ -0,0 +1,264 @@
+# =====================================================================================
+# armsim - a minimal ARM (A32) interpreter. Just enough of the instruction set (and of
+# the GNU assembler's directives) to run the preprocessed AY38910.s on the PC so that
+# ay_parity.py can compare it with AY38910C.c. It is not a general purpose simulator:
+# anything AY38910.s doesn't use raises an exception rather than being guessed at.
+# =====================================================================================
+import re
+
+M = 0xFFFFFFFF
+CONDS = ['eq','ne','cs','cc','mi','pl','vs','vc','hi','ls','ge','lt','gt','le','al','hs','lo']
+DATA_OPS = ['add','sub','rsb','and','orr','eor','bic','mov','mvn','tst','teq','cmp','cmn']
+REGS = {('r%d' % i): i for i in range(16)}
+REGS.update({'sp': 13, 'lr': 14, 'pc': 15, 'ip': 12, 'fp': 11})
+RET = 0xDEAD0000
+
+
+def split_ops(s):
+    out, depth, cur = [], 0, ''
+    for ch in s:
+        if ch in '[{': depth += 1
+        if ch in ']}': depth -= 1
+        if ch == ',' and depth == 0:
+            out.append(cur.strip()); cur = ''
+        else:
+            cur += ch
+    if cur.strip(): out.append(cur.strip())
+    return out
+
+
+class Sim:
+    def __init__(self, src, base=0x10000):
+        self.mem = bytearray(0x100000)
+        self.sym = {}
+        self.code = {}
+        self.builtins = {}
+        self.r = [0] * 16
+        self.N = self.Z = self.C = self.V = 0
+        self._assemble(src, base)
+
+    # ------------------------------------------------------------------ assembly
+    def ev(self, e):
+        e = e.strip().lstrip('#').replace('/', '//')
+        return int(eval(e, {}, self.sym)) & M
+
+    def _assemble(self, src, base):
+        lines = []
+        for raw in src.split('\n'):
+            raw = raw.split(';@')[0].strip()
+            if not raw: continue
+            while True:
+                m = re.match(r'^([A-Za-z_.][\w.]*):\s*(.*)$', raw)
+                if not m: break
+                lines.append(('label', m.group(1)))
+                raw = m.group(2).strip()
+            if raw: lines.append(('stmt', raw))
+        # pass 1 - addresses; pass 2 - emit
+        for pas in (1, 2):
+            addr, struct, soff = base, False, 0
+            for kind, t in lines:
+                if kind == 'label':
+                    if struct:
+                        self.sym[t] = soff
+                        if t == 'aySize': struct = False
+                    else:
+                        self.sym[t] = addr
+                    continue
+                parts = t.split(None, 1)
+                op, rest = parts[0], (parts[1] if len(parts) > 1 else '')
+                if op == '.struct': struct, soff = True, self.ev(rest); continue
+                if struct:
+                    size = {'.short': 2, '.long': 4, '.byte': 1}.get(op)
+                    soff += size if size else self.ev(rest)
+                    continue
+                if op == '.equ':
+                    n, v = rest.split(',', 1); self.sym[n.strip()] = self.ev(v); continue
+                if op in ('.global', '.syntax', '.arm', '.section', '.type', '.end'): continue
+                if op == '.align': addr = (addr + 3) & ~3; continue
+                if op == '.long':
+                    for v in split_ops(rest):
+                        if pas == 2: self.w32(addr, self.ev(v))
+                        addr += 4
+                    continue
+                if op == '.byte':
+                    for v in split_ops(rest):
+                        if pas == 2: self.mem[addr] = self.ev(v) & 0xFF
+                        addr += 1
+                    continue
+                if op == '.space': addr += self.ev(rest); continue
+                if pas == 2: self.code[addr] = self.decode(op, rest, addr)
+                addr += 4
+
+    # ------------------------------------------------------------------ memory
+    def r32(self, a): return int.from_bytes(self.mem[a:a+4], 'little')
+    def w32(self, a, v): self.mem[a:a+4] = (v & M).to_bytes(4, 'little')
+    def r16(self, a): return int.from_bytes(self.mem[a:a+2], 'little')
+    def w16(self, a, v): self.mem[a:a+2] = (v & 0xFFFF).to_bytes(2, 'little')
+
+    # ------------------------------------------------------------------ decode
+    def cond_fn(self, c):
+        s = self
+        return {
+            'al': lambda: True, '': lambda: True,
+            'eq': lambda: s.Z, 'ne': lambda: not s.Z,
+            'cs': lambda: s.C, 'hs': lambda: s.C, 'cc': lambda: not s.C, 'lo': lambda: not s.C,
+            'mi': lambda: s.N, 'pl': lambda: not s.N,
+            'vs': lambda: s.V, 'vc': lambda: not s.V,
+            'hi': lambda: s.C and not s.Z, 'ls': lambda: (not s.C) or s.Z,
+            'ge': lambda: s.N == s.V, 'lt': lambda: s.N != s.V,
+            'gt': lambda: (not s.Z) and s.N == s.V, 'le': lambda: s.Z or s.N != s.V,
+        }[c]
+
+    def reg(self, t): return REGS[t.strip().lower()]
+
+    def op2(self, ops, addr):
+        """Returns fn() -> (value, carry or None)"""
+        s = self
+        if ops[0].startswith('#'):
+            v = self.ev(ops[0])
+            return lambda: (v, None)
+        rm = self.reg(ops[0])
+        if len(ops) == 1:
+            if rm == 15: return lambda: (addr + 8, None)
+            return lambda: (s.r[rm], None)
+        m = re.match(r'(lsl|lsr|asr|ror)\s*#?(.*)', ops[1].strip())
+        kind, n = m.group(1), self.ev(m.group(2))
+        if kind == 'lsl':
+            if n == 0: return lambda: (s.r[rm], None)
+            return lambda: ((s.r[rm] << n) & M, (s.r[rm] >> (32 - n)) & 1)
+        if kind == 'lsr':
+            return lambda: (s.r[rm] >> n, (s.r[rm] >> (n - 1)) & 1)
+        raise Exception('shift ' + kind)
+
+    def decode(self, op, rest, addr):
+        s = self
+        ops = split_ops(rest)
+        # --- branches
+        m = re.match(r'^(bl|bx|b)(' + '|'.join(CONDS) + r')?$', op)
+        if m and op not in ('bic', 'bics'):
+            kind, cf = m.group(1), self.cond_fn(m.group(2) or '')
+            if kind == 'bx':
+                rn = self.reg(ops[0])
+                def f():
+                    if cf(): return s.r[rn]
+                return f
+            target = ops[0]
+            def f():
+                if cf():
+                    if kind == 'bl':
+                        if target in s.builtins:
+                            s.builtins[target](s); return None
+                        s.r[14] = addr + 4
+                    return s.sym[target]
+            return f
+        # --- adr
+        if op == 'adr':
+            rd = self.reg(ops[0]); lab = ops[1]
+            def f(): s.r[rd] = s.sym[lab]
+            return f
+        # --- ldm/stm
+        m = re.match(r'^(ldm|stm)(ia|fd)$', op)
+        if m:
+            base = ops[0].rstrip('!'); wb = ops[0].endswith('!')
+            rn = self.reg(base)
+            regs = []
+            for part in ops[1].strip('{}').split(','):
+                part = part.strip()
+                if '-' in part:
+                    a, b = part.split('-'); regs += list(range(self.reg(a), self.reg(b) + 1))
+                else:
+                    regs.append(self.reg(part))
+            regs.sort()
+            ldm, fd = m.group(1) == 'ldm', m.group(2) == 'fd'
+            def f():
+                if ldm:   # ldmia / ldmfd are both increment-after
+                    a = s.r[rn]; npc = None
+                    for rr in regs:
+                        v = s.r32(a); a += 4
+                        if rr == 15: npc = v
+                        else: s.r[rr] = v
+                    if wb: s.r[rn] = a
+                    return npc
+                else:
+                    a = s.r[rn] - 4 * len(regs) if fd else s.r[rn]
+                    start = a
+                    for rr in regs:
+                        s.w32(a, s.r[rr]); a += 4
+                    if wb: s.r[rn] = start if fd else a
+            return f
+        # --- loads / stores
+        m = re.match(r'^(ldr|str)(h|b)?(' + '|'.join(CONDS) + r')?$', op)
+        if m:
+            ld, size, cf = m.group(1) == 'ldr', m.group(2), self.cond_fn(m.group(3) or '')
+            rd = self.reg(ops[0])
+            if ops[1].startswith('='):
+                lab = ops[1][1:]
+                def f():
+                    if cf(): s.r[rd] = s.sym[lab]
+                return f
+            inner = split_ops(ops[1].strip('[]'))
+            rn = self.reg(inner[0])
+            post = self.ev(ops[2]) if len(ops) > 2 else None
+            if len(inner) == 1: offf = lambda: 0
+            elif inner[1].startswith('#'):
+                k = self.ev(inner[1]); offf = lambda: k
+            else:
+                o2 = self.op2(inner[1:], addr); offf = lambda: o2()[0]
+            def f():
+                if not cf(): return None
+                base = addr + 8 if rn == 15 else s.r[rn]
+                a = base if post is not None else (base + offf()) & M
+                if ld:
+                    v = s.r32(a) if size is None else (s.r16(a) if size == 'h' else s.mem[a])
+                    if rd == 15: return v
+                    s.r[rd] = v
+                else:
+                    v = s.r[rd]
+                    if size is None: s.w32(a, v)
+                    elif size == 'h': s.w16(a, v)
+                    else: s.mem[a] = v & 0xFF
+                if post is not None: s.r[rn] = (base + post) & M
+            return f
+        # --- data processing
+        m = re.match(r'^(' + '|'.join(DATA_OPS) + r')(s)?(' + '|'.join(CONDS) + r')?$', op)
+        if not m: raise Exception('unknown op ' + op)
+        base, S, cf = m.group(1), bool(m.group(2)), self.cond_fn(m.group(3) or '')
+        if base in ('tst', 'teq', 'cmp', 'cmn'): S = True; rd = None; rn = self.reg(ops[0]); o2 = self.op2(ops[1:], addr)
+        elif base in ('mov', 'mvn'): rd = self.reg(ops[0]); rn = None; o2 = self.op2(ops[1:], addr)
+        else:
+            rd = self.reg(ops[0])
+            if len(ops) == 2: rn = rd; o2 = self.op2(ops[1:], addr)
+            else: rn = self.reg(ops[1]); o2 = self.op2(ops[2:], addr)
+        def f():
+            if not cf(): return None
+            b, sc = o2()
+            a = s.r[rn] if rn is not None else 0
+            arith = False
+            if base in ('add', 'cmn'): full = a + b; res = full & M; arith = True; c = full > M; v = ((a ^ res) & (b ^ res)) >> 31
+            elif base in ('sub', 'cmp'): res = (a - b) & M; arith = True; c = a >= b; v = ((a ^ b) & (a ^ res)) >> 31
+            elif base == 'rsb': res = (b - a) & M; arith = True; c = b >= a; v = ((a ^ b) & (b ^ res)) >> 31
+            elif base in ('and', 'tst'): res = a & b
+            elif base == 'orr': res = a | b
+            elif base in ('eor', 'teq'): res = a ^ b
+            elif base == 'bic': res = a & ~b & M
+            elif base == 'mov': res = b
+            elif base == 'mvn': res = ~b & M
+            if S:
+                s.N = res >> 31; s.Z = res == 0
+                if arith: s.C = c; s.V = v
+                elif sc is not None: s.C = sc
+            if rd is not None:
+                if rd == 15: return res
+                s.r[rd] = res
+        return f
+
+    # ------------------------------------------------------------------ run
+    def call(self, fn, *args):
+        for i, a in enumerate(args): self.r[i] = a & M
+        self.r[13] = 0xF0000; self.r[14] = RET
+        pc = self.sym[fn]
+        code = self.code
+        while pc != RET:
+            npc = code[pc]()
+            pc = pc + 4 if npc is None else npc
+        return self.r[0]
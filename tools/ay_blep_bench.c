@@ -0,0 +1,214 @@
+// =====================================================================================
+// ay_blep_bench - compares the two ways SugarDS can make the AY sound: ay38910Mixer
+// (point sampled at 61600 samples a second, as on the DS) and ayBlipMixer (band-
+// limited steps at 22050). This runs on the PC, not the DS, with the C version of
+// the chip and the same AY_UPSHIFT the DS build uses:
+//
+//      cc -O2 -DAY_UPSHIFT=1 -Iarm9/source/cpu/ay38910 -o ay_blep_bench tools/ay_blep_bench.c arm9/source/cpu/ay38910/AY38910C.c arm9/source/cpu/ay38910/AYBlip.c -lm
+//      ay_blep_bench [seconds]
+//
+// First the CPU time each takes per emulated second of busy music (three tones, an
+// envelope and noise, new notes every frame). Then the aliasing - a lone square wave
+// on channel A at a few pitches, windowed and run through an FFT. Everything that
+// isn't DC or one of the wave's own (odd) harmonics below Nyquist is aliasing; we show
+// it against the power of the wave itself in dB (lower is better). The tone periods
+// are odd on purpose: the point sampled wave repeats every 'tp' samples so its aliases
+// can only land on harmonics - with an even period they all hide on the odd ones.
+// =====================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+#include "AY38910.h"
+#include "AYBlip.h"
+
+#define POINT_RATE      61600                       // 2 x 30800 - what WAVE DIRECT and NORMAL play
+#define POINT_TICKS     (POINT_RATE << AY_UPSHIFT)  // ay38910Mixer runs 2^AY_UPSHIFT ticks a sample
+#define BLIP_RATE       22050
+#define BLIP_TICKS      125000                      // The CPC's 1MHz AY clock / 8
+#define FFT_SIZE        32768
+
+typedef struct
+{
+    const char *name;
+    u32 rate;
+    u32 ticks;
+    int blip;
+} path_t;
+
+static const path_t paths[2] =
+{
+    {"POINT 61600", POINT_RATE, POINT_TICKS, 0},
+    {"BLEP  22050", BLIP_RATE,  BLIP_TICKS,  1},
+};
+
+static AY38910 chip;
+static AYBlip blip;
+
+static void ay_write(u8 reg, u8 value)
+{
+    ay38910IndexW(reg, &chip);
+    ay38910DataW(value, &chip);
+}
+
+static void render(const path_t *p, s16 *dest, int count)
+{
+    if (p->blip) ayBlipMixer(count, dest, &chip, &blip);
+    else ay38910Mixer(count, dest, &chip);
+}
+
+static void reset(const path_t *p)
+{
+    ay38910Reset(&chip);
+    ayBlipInit(&blip, p->ticks, p->rate);
+}
+
+// -------------------------------------------------------------------------------------
+// Busy music - every frame each channel gets a new note, channel C an envelope every so
+// often and noise comes and goes. We take the best of three runs for each path.
+// -------------------------------------------------------------------------------------
+static double time_music(const path_t *p, int seconds, u32 *samples)
+{
+    static s16 buf[BLIP_TICKS];
+    u32 seed = 1234;
+
+    reset(p);
+    ay_write(7, 0x38);
+    ay_write(8, 15); ay_write(9, 13); ay_write(10, 0x10);
+    ay_write(11, 0x40); ay_write(12, 0); ay_write(13, 0x0E);
+
+    *samples = 0;
+    clock_t start = clock();
+    for (int frame=0; frame<seconds*50; frame++)
+    {
+        for (u8 reg=0; reg<6; reg+=2)
+        {
+            seed = seed * 1103515245 + 12345;
+            u16 tp = 30 + ((seed >> 16) % 900);
+            ay_write(reg, tp & 0xFF);
+            ay_write(reg+1, tp >> 8);
+        }
+        if ((frame & 15) == 0) ay_write(13, 0x0E);
+        ay_write(7, (frame & 32) ? 0x18 : 0x38);
+        ay_write(6, frame & 0x1F);
+
+        u32 n = ((frame+1) * p->rate) / 50 - (frame * p->rate) / 50;
+        render(p, buf, n);
+        *samples += n;
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void fft(double *re, double *im, int n)
+{
+    for (int i=1, j=0; i<n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {double t = re[i]; re[i] = re[j]; re[j] = t; t = im[i]; im[i] = im[j]; im[j] = t;}
+    }
+    for (int len=2; len<=n; len<<=1)
+    {
+        double a = -2 * M_PI / len;
+        for (int i=0; i<n; i+=len)
+        {
+            for (int k=0; k<len/2; k++)
+            {
+                double wr = cos(a*k), wi = sin(a*k);
+                double xr = re[i+k+len/2] * wr - im[i+k+len/2] * wi;
+                double xi = re[i+k+len/2] * wi + im[i+k+len/2] * wr;
+                re[i+k+len/2] = re[i+k] - xr; im[i+k+len/2] = im[i+k] - xi;
+                re[i+k] += xr; im[i+k] += xi;
+            }
+        }
+    }
+}
+
+// -------------------------------------------------------------------------------------
+// A square wave with tone period 'tp' on channel A. The wave is at ticks / (2 x tp) Hz
+// and has odd harmonics only. Returns the aliasing power against the wave in dB.
+// -------------------------------------------------------------------------------------
+static double alias_db(const path_t *p, u16 tp, double *freq)
+{
+    static s16 buf[FFT_SIZE];
+    static double re[FFT_SIZE], im[FFT_SIZE];
+
+    reset(p);
+    ay_write(7, 0x3E);
+    ay_write(8, 15);
+    ay_write(0, tp & 0xFF);
+    ay_write(1, tp >> 8);
+    render(p, buf, 4096);           // Let the filters settle
+    render(p, buf, FFT_SIZE);
+
+    for (int i=0; i<FFT_SIZE; i++)
+    {
+        double x = 2 * M_PI * i / FFT_SIZE;   // Blackman-Harris - the side lobes are under -90dB
+        double w = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2*x) - 0.01168 * cos(3*x);
+        re[i] = buf[i] * w;
+        im[i] = 0;
+    }
+    fft(re, im, FFT_SIZE);
+
+    *freq = (double)p->ticks / (2 * tp);
+    double bin_hz = (double)p->rate / FFT_SIZE;
+    double wave = 0, alias = 0;
+
+    for (int k=1; k<FFT_SIZE/2; k++)
+    {
+        double power = re[k]*re[k] + im[k]*im[k];
+        double f = k * bin_hz;
+        if (f < 6 * bin_hz) continue; // DC (and the window's spread of it)
+
+        int harmonic = 0;
+        for (double h=*freq; h < p->rate / 2.0; h += 2 * *freq)
+        {
+            if (fabs(f - h) <= 6 * bin_hz) {harmonic = 1; break;}
+        }
+        if (harmonic) wave += power; else alias += power;
+    }
+    return 10 * log10((alias + 1e-9) / wave);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = (argc > 1) ? atoi(argv[1]) : 60;
+    u16 periods[] = {9, 19, 29, 47, 71, 143};
+
+    printf("CPU TIME FOR %d EMULATED SECONDS OF MUSIC\n", seconds);
+    for (int i=0; i<2; i++)
+    {
+        u32 samples;
+        double t = time_music(&paths[i], seconds, &samples);
+        for (int run=1; run<3; run++)
+        {
+            double again = time_music(&paths[i], seconds, &samples);
+            if (again < t) t = again;
+        }
+        printf("  %s  %8.1f us per emulated second  %7lu samples\n", paths[i].name, t * 1e6 / seconds, (unsigned long)(samples / seconds));
+    }
+
+    printf("\nALIASING (POWER NOT IN THE WAVE'S OWN HARMONICS)\n");
+    for (int j=0; j<(int)(sizeof(periods)/sizeof(periods[0])); j++)
+    {
+        printf("  TP %3d", periods[j]);
+        for (int i=0; i<2; i++)
+        {
+            double f, db = alias_db(&paths[i], periods[j], &f);
+            printf("   %s %6.0fHz %7.1fdB", paths[i].name, f, db);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+// =====================================================================================
+// ay_parity - the C half of the AY38910.s / AY38910C.c parity check. Reads a script of
+// chip operations on stdin, runs them on the C version of the chip and prints what
+// came out - one line per read, mixer run, save/load or state dump. ay_parity.py runs
+// the same script on the assembly (in armsim.py) and compares the two line for line.
+// This runs on the PC, not the DS - build it with the AY_UPSHIFT under test:
+//
+//      cc -O2 -DAY_UPSHIFT=1 -Iarm9/source/cpu/ay38910 -o ay_parity tools/ay_parity.c arm9/source/cpu/ay38910/AY38910C.c
+//      ay_parity < script
+//
+// The script is one operation a line: R (reset), I reg (index write), W val (data
+// write), D (data read), M count (mix that many samples - we print a hash of them and
+// the last one), S (save state), L 16 bytes (load state) and P (dump the whole struct
+// bar the pointers). Numbers are in hex apart from the M count.
+// =====================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+#include "AY38910.h"
+
+static AY38910 chip;
+static s16 samples[0x10000];
+
+static void dump_chip(void)
+{
+    printf("ST %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x %x",
+           chip.ch0Freq, chip.ch0Addr, chip.ch1Freq, chip.ch1Addr, chip.ch2Freq, chip.ch2Addr, chip.ch3Freq, chip.ch3Addr,
+           chip.ayRng, chip.ayEnvFreq, chip.ayChState, chip.ayChDisable, chip.ayEnvType, chip.ayEnvAddr,
+           chip.ayOldSample, chip.ayAttChg, chip.ayRegIndex, chip.ayPortAOut);
+    for (int i=0; i<8; i++)  printf(" %x", (u16)chip.ayCalculatedVolumes[i]);
+    for (int i=0; i<16; i++) printf(" %x", chip.ayRegs[i]);
+    printf("\n");
+}
+
+int main(void)
+{
+    char op[8];
+    unsigned val;
+    u8 state[16];
+
+    while (scanf("%7s", op) == 1)
+    {
+        switch (op[0])
+        {
+            case 'R':
+                ay38910Reset(&chip);
+                break;
+            case 'I':
+                if (scanf("%x", &val) != 1) return 2;
+                ay38910IndexW(val, &chip);
+                break;
+            case 'W':
+                if (scanf("%x", &val) != 1) return 2;
+                ay38910DataW(val, &chip);
+                break;
+            case 'D':
+                printf("D %x\n", ay38910DataR(&chip));
+                break;
+            case 'M':
+                if ((scanf("%u", &val) != 1) || (val == 0) || (val > 0x10000)) return 2;
+                ay38910Mixer(val, samples, &chip);
+                u32 hash = 0;
+                for (unsigned i=0; i<val; i++) hash = hash*31 + (u16)samples[i];
+                printf("M %u %x %x\n", val, hash, (u16)samples[val-1]);
+                break;
+            case 'S':
+                printf("S %d", ay38910SaveState(state, &chip));
+                for (int i=0; i<16; i++) printf(" %x", state[i]);
+                printf("\n");
+                break;
+            case 'L':
+                for (int i=0; i<16; i++)
+                {
+                    if (scanf("%x", &val) != 1) return 2;
+                    state[i] = val;
+                }
+                printf("L %d\n", ay38910LoadState(&chip, state));
+                break;
+            case 'P':
+                dump_chip();
+                break;
+            default:
+                return 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+# =====================================================================================
+# ay_parity - checks that AY38910C.c behaves exactly like AY38910.s. Random scripts of
+# register writes (weighted to the tone, noise, mixer, volume and envelope registers),
+# data reads, save/load states and mixer runs of all sorts of lengths are run through
+# the assembly - preprocessed for the DS and interpreted by armsim.py - and through
+# tools/ay_parity (the C version built with the same AY_UPSHIFT). Every read value, every
+# sample buffer (as a hash plus its last sample) and a dump of the whole chip struct
+# after each script must match. Runs on the PC - see the ay-parity target in the tools
+# Makefile, which does the preprocessing and builds the C half:
+#
+#      python3 ay_parity.py <preprocessed AY38910.s> <ay_parity binary> [seeds] [ops]
+#
+# Exits non-zero (after showing the first few differences) if anything didn't match.
+# =====================================================================================
+import os
+import random
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from armsim import Sim
+
+CHIP, DEST, STATE = 0x80000, 0x90000, 0xA0000       # Where the struct and buffers go in the simulator
+
+
+def make_script(seed, ops):
+    rnd = random.Random(seed)
+    script = ['R', 'I 7', 'W 3f', 'M 4']
+    for _ in range(ops):
+        k = rnd.random()
+        if k < 0.55:
+            reg = rnd.choice([0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 13, 8, 9, 10, 7, 6, 14, 15])
+            val = rnd.choice([0, 1, 2, rnd.randrange(256), rnd.randrange(16), 0x10 | rnd.randrange(16), rnd.randrange(4)])
+            script += ['I %x' % reg, 'W %x' % val]
+        elif k < 0.58: script += ['I %x' % rnd.randrange(32), 'D']
+        elif k < 0.60: script += ['S']
+        elif k < 0.61: script += ['L ' + ' '.join('%x' % rnd.randrange(256) for _ in range(16))]
+        elif k < 0.62: script += ['P']
+        else: script += ['M %d' % rnd.choice([4, 8, 16, 40, 96, 128, 1, 3])]
+    return script + ['P']
+
+
+# The assembly's side of ay_parity.c - the same operations and the same output lines
+def run_asm(sim, script):
+    sym = sim.sym
+    g8 = lambda o: sim.mem[CHIP + sym[o]]
+    g16 = lambda o: sim.r16(CHIP + sym[o])
+    g32 = lambda o: sim.r32(CHIP + sym[o])
+    out = []
+    for line in script:
+        p = line.split()
+        if p[0] == 'R': sim.call('ay38910Reset', CHIP)
+        elif p[0] == 'I': sim.call('ay38910IndexW', int(p[1], 16), CHIP)
+        elif p[0] == 'W': sim.call('ay38910DataW', int(p[1], 16), CHIP)
+        elif p[0] == 'D': out.append('D %x' % (sim.call('ay38910DataR', CHIP) & 0xFF))
+        elif p[0] == 'M':
+            n = int(p[1])
+            sim.call('ay38910Mixer', n, DEST, CHIP)
+            h = 0
+            for i in range(n): h = (h * 31 + sim.r16(DEST + 2 * i)) & 0xFFFFFFFF
+            out.append('M %d %x %x' % (n, h, sim.r16(DEST + 2 * (n - 1))))
+        elif p[0] == 'S':
+            n = sim.call('ay38910SaveState', STATE, CHIP)
+            out.append('S %d ' % n + ' '.join('%x' % sim.mem[STATE + i] for i in range(16)))
+        elif p[0] == 'L':
+            for i in range(16): sim.mem[STATE + i] = int(p[1 + i], 16)
+            out.append('L %d' % sim.call('ay38910LoadState', CHIP, STATE))
+        elif p[0] == 'P':
+            f = [g16('ayCh0Freq'), g16('ayCh0Addr'), g16('ayCh1Freq'), g16('ayCh1Addr'),
+                 g16('ayCh2Freq'), g16('ayCh2Addr'), g16('ayCh3Freq'), g16('ayCh3Addr'),
+                 g32('ayRng'), g32('ayEnvFreq'), g8('ayChState'), g8('ayChDisable'), g8('ayEnvType'), g8('ayEnvAddr'),
+                 g32('ayOldSample'), g8('ayAttChg'), g8('ayRegIndex'), g8('ayPortAOut')]
+            f += [sim.r16(CHIP + sym['ayCalculatedVolumes'] + 2 * i) for i in range(8)]
+            f += [sim.mem[CHIP + sym['ayRegs'] + i] for i in range(16)]
+            out.append('ST ' + ' '.join('%x' % x for x in f))
+    return out
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('usage: ay_parity.py <preprocessed AY38910.s> <ay_parity binary> [seeds] [ops]')
+    src = open(sys.argv[1]).read()
+    cbin = sys.argv[2]
+    seeds = int(sys.argv[3]) if len(sys.argv) > 3 else 4
+    ops = int(sys.argv[4]) if len(sys.argv) > 4 else 1500
+
+    failed = 0
+    for seed in range(1, seeds + 1):
+        sim = Sim(src)
+        sim.builtins['memcpy'] = lambda s: s.mem.__setitem__(slice(s.r[0], s.r[0] + s.r[2]), s.mem[s.r[1]:s.r[1] + s.r[2]])
+        script = make_script(seed, ops)
+        asm = run_asm(sim, script)
+        c = subprocess.run([cbin], input='\n'.join(script) + '\n', capture_output=True, text=True).stdout.strip().split('\n')
+        diffs = [(a, b) for a, b in zip(asm, c) if a != b]
+        bad = len(diffs) + abs(len(asm) - len(c))
+        samples = sum(int(l.split()[1]) for l in asm if l.startswith('M'))
+        print('seed %d: %d results, %d samples, %d mismatches' % (seed, len(asm), samples, bad))
+        for a, b in diffs[:3]: print('   asm', a, '\n     C', b)
+        failed += bad
+    print('FAIL' if failed else 'PASS')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
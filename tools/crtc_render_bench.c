@@ -0,0 +1,280 @@
+// =====================================================================================
+// crtc_render_bench - checks the line renderers in arm9/source/crtc_lines.h (one per
+// mode, 32K wrap and pan-and-scan combination) against the byte-at-a-time loop that
+// crtc_render_screen_line() used before them, then times the two. This runs on the PC,
+// not the DS, with random screen RAM and random pre-inked tables:
+//
+//      cc -O2 -Iarm9/source -o crtc_render_bench tools/crtc_render_bench.c
+//      crtc_render_bench [lines]
+//
+// First the pixel check - every line drawn both ways into buffers filled with the same
+// junk and compared word for word, the whole buffer, so a renderer that draws a pair
+// too many or too few is caught as well as one that draws the wrong pixels. The lines
+// are random: mode, pan-and-scan, 32K screen, CRTC[1] (mostly sane, sometimes out to
+// 255), the pan offsets and a start offset that is often just short of the 2K wrap.
+// Then the time for a 200 line frame of a standard 40 column screen in each mode - the
+// best of a few goes each, taking turns, so a busy PC is less likely to skew it.
+// =====================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#define ITCM_CODE
+
+// What the renderers read from the rest of the emulator
+u8  CRTC[0x20];
+u32 border_color = 0xEEEEEEEE;
+u8  mode1_offset;
+u8  mode2_offset;
+u32 pre_inked_mode0[256];
+u32 pre_inked_mode1[256];
+u32 pre_inked_mode2a[256];
+u32 pre_inked_mode2b[256];
+u32 pre_inked_mode2c[256];
+
+#include "crtc_lines.h"
+
+#define LINE_WORDS      1024        // More than the 2 x 255 words a line can ever be
+#define BENCH_FRAMES    5000
+#define BENCH_REPEATS   7
+
+static u8  RAM[0x10000 + 0x800];   // Room for a 32K screen at the top and a pan read past it
+static u32 line_old[LINE_WORDS];
+static u32 line_new[LINE_WORDS];
+
+static u32 rng = 1;
+static u32 rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// ------------------------------------------------------------------------------------------
+// The line drawing from crtc_render_screen_line() as it was before the renderers - a byte
+// pair at a time with the wrap checked after each. Only the frame stats are left out.
+// ------------------------------------------------------------------------------------------
+static u32 *old_render(u32 *vidBufDS, u8 *pixelPtr2K, u32 offset, u8 mode, u8 panAndScan, u8 b32K_Mode)
+{
+    if (mode == 0x00) // Mode 0  (160x256)
+    {
+        for (int x=0; x<CRTC[1]; x++)
+        {
+            *vidBufDS++ = pre_inked_mode0[pixelPtr2K[offset++]];
+            *vidBufDS++ = pre_inked_mode0[pixelPtr2K[offset++]];
+            if (b32K_Mode)
+            {
+                if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+            }
+            offset &= 0x47FF;
+        }
+        for (u16 i=CRTC[1]; i<48;i++)
+        {
+            *vidBufDS++ = border_color;
+            *vidBufDS++ = border_color;
+        }
+    }
+    else if (mode == 0x01) // Mode 1 (320x256)
+    {
+        if (panAndScan != 0)
+        {
+            if (mode1_offset)
+            {
+                offset = (offset+mode1_offset) & 0x47FF;
+                if (b32K_Mode)
+                {
+                    if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+                }
+                offset &= 0x47FF;
+            }
+        }
+        for (int x=0; x<(CRTC[1]); x++)
+        {
+            *vidBufDS++ = pre_inked_mode1[pixelPtr2K[offset++]];
+            *vidBufDS++ = pre_inked_mode1[pixelPtr2K[offset++]];
+            if (b32K_Mode)
+            {
+                if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+            }
+            offset &= 0x47FF;
+        }
+        for (u16 i=CRTC[1]; i<48;i++)
+        {
+            *vidBufDS++ = border_color;
+            *vidBufDS++ = border_color;
+        }
+    }
+    else // Mode 2 (640x256)
+    {
+        if (panAndScan == 0)
+        {
+            u8 limit = (CRTC[1] <= 48) ? CRTC[1] : 48;
+            for (int x=0; x<limit; x++)
+            {
+                *vidBufDS++ = pre_inked_mode2c[pixelPtr2K[offset]];
+                offset++;
+                *vidBufDS++ = pre_inked_mode2c[pixelPtr2K[offset]];
+                offset++;
+                if (b32K_Mode)
+                {
+                    if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+                }
+                offset &= 0x47FF;
+            }
+            for (int x=limit; x<48; x++)
+            {
+                *vidBufDS++ = border_color;
+                *vidBufDS++ = border_color;
+            }
+        }
+        else
+        {
+            if (mode2_offset)
+            {
+                offset = (offset+mode2_offset) & 0x47FF;
+                if (b32K_Mode)
+                {
+                    if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+                }
+                offset &= 0x47FF;
+            }
+            for (int x=0; x<40; x++)
+            {
+                if (x+mode2_offset < (CRTC[1]*2))
+                {
+                    *vidBufDS++ = pre_inked_mode2a[pixelPtr2K[offset]];
+                    *vidBufDS++ = pre_inked_mode2b[pixelPtr2K[offset]];
+                    offset++;
+                    if (b32K_Mode)
+                    {
+                        if ((offset&0xFFF) >= 0x800) offset += 0x4000;
+                    }
+                    offset &= 0x47FF;
+                }
+                else
+                {
+                    *vidBufDS++ = border_color;
+                    *vidBufDS++ = border_color;
+                }
+            }
+        }
+    }
+    return vidBufDS;
+}
+
+// The emulator picked the way to draw at run time, for every line - so must we
+static u32 *(*volatile old_render_call)(u32 *, u8 *, u32, u8, u8, u8) = old_render;
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the number of lines that came out different
+static long check_lines(long lines)
+{
+    long bad = 0;
+
+    for (long t=0; t<lines; t++)
+    {
+        u8 mode       = rnd() % 3;
+        u8 panAndScan = rnd() & 1;
+        u8 b32K_Mode  = rnd() & 1;
+
+        CRTC[1] = (t & 3) ? (rnd() % 64) : (rnd() & 0xFF);
+        mode1_offset = (t & 7) ? (rnd() % 17) : 0;
+        mode2_offset = (t & 7) ? (rnd() % 49) : 0;
+
+        u32 offset = rnd() & (b32K_Mode ? 0x47FF : 0x7FF);             // Only the 32K screen starts in the upper 16K
+        if (t & 1) offset = (offset & 0x4000) | ((0x800 - 1 - (rnd() % 40)) & 0x7FF);   // Just short of the wrap
+
+        // A 32K screen reaches 16K past pixelPtr2K - the renderers add the 0x4000 themselves
+        u8 *pixelPtr2K = b32K_Mode ? &RAM[0x8000 + (rnd() % 4) * 0x800] : &RAM[(rnd() % 32) * 0x800];
+
+        memset(line_old, 0x55, sizeof(line_old));
+        memset(line_new, 0x55, sizeof(line_new));
+        u32 *end_old = old_render(line_old, pixelPtr2K, offset, mode, panAndScan, b32K_Mode);
+        u32 *end_new = line_renderers[mode][panAndScan][b32K_Mode](line_new, pixelPtr2K, offset);
+
+        if (memcmp(line_old, line_new, sizeof(line_old)) || ((end_old - line_old) != (end_new - line_new)))
+        {
+            if (bad < 8) printf("DIFF mode %d pan %d 32K %d CRTC[1]=%-3d offset=%04X mode1_offset=%-2d mode2_offset=%d\n",
+                                mode, panAndScan, b32K_Mode, CRTC[1], offset, mode1_offset, mode2_offset);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// One 200 line frame of 25 character rows of 8 lines, each row 80 bytes on - starting close
+// enough to the end of the 2K that some of them wrap
+static void bench_frame(int way, u8 mode, u8 panAndScan, u8 b32K_Mode)
+{
+    for (int line=0; line<200; line++)
+    {
+        u32 offset = ((line >> 3) * 80 + 0x7C0) & 0x7FF;
+        u8 *pixelPtr2K = &RAM[(b32K_Mode ? 0x8000 : 0xC000) + (line & 7) * 0x800];
+        if (way) line_renderers[mode][panAndScan][b32K_Mode](line_new, pixelPtr2K, offset);
+        else     old_render_call(line_old, pixelPtr2K, offset, mode, panAndScan, b32K_Mode);
+    }
+}
+
+// The two ways take turns and each keeps its best time so a busy PC doesn't skew one of them
+static void bench(const char *name, u8 mode, u8 panAndScan, u8 b32K_Mode, u8 pan_offset)
+{
+    double best[2] = {1e9, 1e9};
+
+    CRTC[1] = 40;
+    mode1_offset = pan_offset;
+    mode2_offset = 22;
+
+    for (int rep=0; rep<BENCH_REPEATS; rep++)
+    {
+        for (int way=0; way<2; way++)
+        {
+            double start = seconds();
+            for (int frame=0; frame<BENCH_FRAMES; frame++) bench_frame(way, mode, panAndScan, b32K_Mode);
+            double t = seconds() - start;
+            if (t < best[way]) best[way] = t;
+        }
+    }
+    printf("%-14s  old %7.2f us/frame   new %7.2f us/frame   %.2fx\n", name,
+           best[0] / BENCH_FRAMES * 1e6, best[1] / BENCH_FRAMES * 1e6, best[0] / best[1]);
+}
+
+int main(int argc, char *argv[])
+{
+    long lines = (argc > 1) ? atol(argv[1]) : 2000000;
+
+    for (u32 i=0; i<sizeof(RAM); i++) RAM[i] = rnd();
+    for (int i=0; i<256; i++)
+    {
+        pre_inked_mode0[i]  = rnd();
+        pre_inked_mode1[i]  = rnd();
+        pre_inked_mode2a[i] = rnd();
+        pre_inked_mode2b[i] = rnd();
+        pre_inked_mode2c[i] = rnd();
+    }
+
+    long bad = check_lines(lines);
+    printf("%ld/%ld lines differ\n", bad, lines);
+
+    bench("mode 0",         0, 0, 0, 8);
+    bench("mode 1",         1, 0, 0, 8);
+    bench("mode 1 pan",     1, 1, 0, 8);
+    bench("mode 1 pan odd", 1, 1, 0, 7);
+    bench("mode 2",         2, 0, 0, 8);
+    bench("mode 2 pan",     2, 1, 0, 8);
+    bench("mode 1 32K",     1, 0, 1, 8);
+
+    return bad ? 1 : 0;
+}
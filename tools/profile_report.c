@@ -0,0 +1,297 @@
+// =====================================================================================
+// profile_report - prints the hot spots out of a /data/profile_<crc>.txt file written
+// by SugarDS when built with Z80_PROFILE (the dump happens when the debugger pause key
+// is pressed). This runs on the PC, not the DS:
+//
+//      cc -O2 -o profile_report tools/profile_report.c
+//      profile_report profile_1234ABCD.txt [top]
+//
+// We show the time per memory bank, the top PCs by T-states and the hottest loops. A
+// loop is any backward JR/DJNZ/JP that was taken and covers everything from its target
+// to itself. Opcode bytes come from the dump so only the first 4 bytes of each opcode
+// are known - plenty for the disassembly.
+// =====================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    unsigned pc;
+    unsigned long count;
+    unsigned long cycles;
+    unsigned char op[4];
+} entry_t;
+
+static entry_t *entries;
+static int num_entries;
+static int index_of[0x10000];
+static unsigned long total_cycles;
+
+static const char *r8[8]  = {"B","C","D","E","H","L","(HL)","A"};
+static const char *rp[4]  = {"BC","DE","HL","SP"};
+static const char *rp2[4] = {"BC","DE","HL","AF"};
+static const char *cc[8]  = {"NZ","Z","NC","C","PO","PE","P","M"};
+static const char *alu[8] = {"ADD A,","ADC A,","SUB ","SBC A,","AND ","XOR ","OR ","CP "};
+static const char *rot[8] = {"RLC","RRC","RL","RR","SLA","SRA","SLL","SRL"};
+
+// -------------------------------------------------------------------------------------
+// A compact table-free Z80 disassembler using the usual x/y/z/p/q split of the opcode.
+// Returns the opcode length and sets *target for relative/absolute jumps (else -1).
+// -------------------------------------------------------------------------------------
+static int disasm(unsigned pc, const unsigned char *b, char *out, long *target)
+{
+    const char *ix = NULL;
+    int len = 0;
+    char hl[16], mem[16], r[8][16];
+
+    *target = -1;
+    if ((b[0] == 0xDD) || (b[0] == 0xFD)) {ix = (b[0] == 0xDD) ? "IX" : "IY"; b++; len++;}
+
+    unsigned char op = b[0];
+    int x = op >> 6, y = (op >> 3) & 7, z = op & 7, p = y >> 1, q = y & 1;
+    int d = (signed char) b[1];
+    unsigned n = b[1], nn = b[1] | (b[2] << 8);
+
+    strcpy(hl, ix ? ix : "HL");
+    if (ix) sprintf(mem, "(%s%+d)", ix, d); else strcpy(mem, "(HL)");
+    for (int i=0; i<8; i++) strcpy(r[i], r8[i]);
+    strcpy(r[6], mem);
+
+    if (op == 0xCB)
+    {
+        if (ix) {op = b[2]; len += 4;} else {op = b[1]; len += 2;}
+        x = op >> 6; y = (op >> 3) & 7; z = op & 7;
+        const char *t = ix ? mem : r8[z];
+        if (x == 0) sprintf(out, "%s %s", rot[y], t);
+        else sprintf(out, "%s %d,%s", (x == 1) ? "BIT" : (x == 2) ? "RES" : "SET", y, t);
+        return len;
+    }
+
+    if (op == 0xED)
+    {
+        op = b[1]; len += 2;
+        x = op >> 6; y = (op >> 3) & 7; z = op & 7; p = y >> 1; q = y & 1;
+        nn = b[2] | (b[3] << 8);
+        if (x == 1)
+        {
+            switch (z)
+            {
+                case 0: sprintf(out, (y == 6) ? "IN (C)" : "IN %s,(C)", r8[y]); return len;
+                case 1: sprintf(out, (y == 6) ? "OUT (C),0" : "OUT (C),%s", r8[y]); return len;
+                case 2: sprintf(out, "%s HL,%s", q ? "ADC" : "SBC", rp[p]); return len;
+                case 3: if (q) sprintf(out, "LD %s,(%04X)", rp[p], nn); else sprintf(out, "LD (%04X),%s", nn, rp[p]); return len + 2;
+                case 4: strcpy(out, "NEG"); return len;
+                case 5: strcpy(out, (y == 1) ? "RETI" : "RETN"); return len;
+                case 6: sprintf(out, "IM %d", (y & 3) ? (y & 3) - 1 : 0); return len;
+                default:
+                {
+                    static const char *m[8] = {"LD I,A","LD R,A","LD A,I","LD A,R","RRD","RLD","NOP","NOP"};
+                    strcpy(out, m[y]); return len;
+                }
+            }
+        }
+        if ((x == 2) && (y >= 4) && (z <= 3))
+        {
+            static const char *bl[4][4] = {{"LDI","CPI","INI","OUTI"},{"LDD","CPD","IND","OUTD"},
+                                           {"LDIR","CPIR","INIR","OTIR"},{"LDDR","CPDR","INDR","OTDR"}};
+            strcpy(out, bl[y-4][z]); return len;
+        }
+        sprintf(out, "DB ED,%02X", op); return len;
+    }
+
+    // Operand bytes follow the displacement for (IX+d) forms
+    int dlen = (ix && (((x == 1) && ((y == 6) != (z == 6))) || ((x == 2) && (z == 6)) ||
+                       ((x == 0) && ((z == 4) || (z == 5) || (z == 6)) && (y == 6)))) ? 1 : 0;
+    if (dlen) {n = b[2]; nn = b[2] | (b[3] << 8);}
+    len += 1 + dlen;
+    if (ix) {sprintf(r[4], "%sH", ix); sprintf(r[5], "%sL", ix);}
+
+    switch (x)
+    {
+        case 0:
+            switch (z)
+            {
+                case 0:
+                    if (y == 0) {strcpy(out, "NOP"); return len;}
+                    if (y == 1) {strcpy(out, "EX AF,AF'"); return len;}
+                    *target = (pc + 2 + (signed char) b[1]) & 0xFFFF;
+                    if (y == 2) sprintf(out, "DJNZ %04lX", *target);
+                    else if (y == 3) sprintf(out, "JR %04lX", *target);
+                    else sprintf(out, "JR %s,%04lX", cc[y-4], *target);
+                    return len + 1;
+                case 1: if (q) sprintf(out, "ADD %s,%s", hl, (p == 2) ? hl : rp[p]); else {sprintf(out, "LD %s,%04X", (p == 2) ? hl : rp[p], nn); len += 2;} return len;
+                case 2:
+                {
+                    static const char *m[8] = {"LD (BC),A","LD A,(BC)","LD (DE),A","LD A,(DE)"};
+                    if (p < 2) {strcpy(out, m[y]); return len;}
+                    if (p == 2) {if (q) sprintf(out, "LD %s,(%04X)", hl, nn); else sprintf(out, "LD (%04X),%s", nn, hl);}
+                    else sprintf(out, q ? "LD A,(%04X)" : "LD (%04X),A", nn);
+                    return len + 2;
+                }
+                case 3: sprintf(out, "%s %s", q ? "DEC" : "INC", (p == 2) ? hl : rp[p]); return len;
+                case 4: sprintf(out, "INC %s", (y == 6) ? mem : r[y]); return len;
+                case 5: sprintf(out, "DEC %s", (y == 6) ? mem : r[y]); return len;
+                case 6: sprintf(out, "LD %s,%02X", (y == 6) ? mem : r[y], n); return len + 1;
+                default:
+                {
+                    static const char *m[8] = {"RLCA","RRCA","RLA","RRA","DAA","CPL","SCF","CCF"};
+                    strcpy(out, m[y]); return len;
+                }
+            }
+        case 1:
+            if (op == 0x76) {strcpy(out, "HALT"); return len;}
+            sprintf(out, "LD %s,%s", (y == 6) ? mem : (z == 6) ? r8[y] : r[y], (z == 6) ? mem : (y == 6) ? r8[z] : r[z]);
+            return len;
+        case 2:
+            sprintf(out, "%s%s", alu[y], (z == 6) ? mem : r[z]);
+            return len;
+        default:
+            switch (z)
+            {
+                case 0: sprintf(out, "RET %s", cc[y]); return len;
+                case 1:
+                    if (!q) {sprintf(out, "POP %s", (p == 2) ? hl : rp2[p]); return len;}
+                    if (p == 0) strcpy(out, "RET");
+                    else if (p == 1) strcpy(out, "EXX");
+                    else if (p == 2) sprintf(out, "JP (%s)", hl);
+                    else sprintf(out, "LD SP,%s", hl);
+                    return len;
+                case 2: *target = nn; sprintf(out, "JP %s,%04X", cc[y], nn); return len + 2;
+                case 3:
+                    switch (y)
+                    {
+                        case 0: *target = nn; sprintf(out, "JP %04X", nn); return len + 2;
+                        case 2: sprintf(out, "OUT (%02X),A", n); return len + 1;
+                        case 3: sprintf(out, "IN A,(%02X)", n); return len + 1;
+                        case 4: sprintf(out, "EX (SP),%s", hl); return len;
+                        case 5: strcpy(out, "EX DE,HL"); return len;
+                        case 6: strcpy(out, "DI"); return len;
+                        default: strcpy(out, "EI"); return len;
+                    }
+                case 4: sprintf(out, "CALL %s,%04X", cc[y], nn); return len + 2;
+                case 5:
+                    if (!q) {sprintf(out, "PUSH %s", (p == 2) ? hl : rp2[p]); return len;}
+                    sprintf(out, "CALL %04X", nn); return len + 2;
+                case 6: sprintf(out, "%s%02X", alu[y], n); return len + 1;
+                default: sprintf(out, "RST %02X", y * 8); return len;
+            }
+    }
+}
+
+static int by_cycles(const void *a, const void *b)
+{
+    const entry_t *ea = a, *eb = b;
+    return (eb->cycles > ea->cycles) - (eb->cycles < ea->cycles);
+}
+
+typedef struct
+{
+    unsigned start, end;
+    unsigned long iterations;
+    unsigned long cycles;
+} loop_t;
+
+static int loop_by_cycles(const void *a, const void *b)
+{
+    const loop_t *la = a, *lb = b;
+    return (lb->cycles > la->cycles) - (lb->cycles < la->cycles);
+}
+
+static void print_entry(const entry_t *e)
+{
+    char text[32];
+    long target;
+    disasm(e->pc, e->op, text, &target);
+    printf("  %04X  %-20s %10lu %12lu %6.2f%%\n", e->pc, text, e->count, e->cycles,
+           total_cycles ? (100.0 * e->cycles / total_cycles) : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    char line[256];
+    int top = (argc > 2) ? atoi(argv[2]) : 20;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s profile_<crc>.txt [top]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "r");
+    if (!fp) {perror(argv[1]); return 1;}
+
+    entries = calloc(0x10000, sizeof(entry_t));
+    memset(index_of, 0xFF, sizeof(index_of));
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        unsigned pc, op[4];
+        entry_t *e = &entries[num_entries];
+
+        if (line[0] == '#') {fputs(line + 2, stdout); continue;}
+        if (!strncmp(line, "BANK ", 5)) continue;  // Banks are printed on the second pass below
+        if (sscanf(line, "%x %lu %lu %x %x %x %x", &pc, &e->count, &e->cycles, &op[0], &op[1], &op[2], &op[3]) == 7)
+        {
+            e->pc = pc & 0xFFFF;
+            for (int i=0; i<4; i++) e->op[i] = op[i];
+            total_cycles += e->cycles;
+            index_of[e->pc] = num_entries++;
+        }
+    }
+
+    // Banks are "BANK <name> <cycles>" where the name itself may contain a space
+    printf("\nT-states per bank:\n");
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (strncmp(line, "BANK ", 5)) continue;
+        char *last = strrchr(line, ' ');
+        unsigned long cycles = strtoul(last + 1, NULL, 10);
+        *last = 0;
+        while ((last > line + 5) && (last[-1] == ' ')) *--last = 0;
+        printf("  %-10s %12lu %6.2f%%\n", line + 5, cycles, total_cycles ? (100.0 * cycles / total_cycles) : 0.0);
+    }
+    fclose(fp);
+
+    // Hot loops come from the backward jumps that were actually run
+    loop_t *loops = calloc(num_entries + 1, sizeof(loop_t));
+    int num_loops = 0;
+    for (int i=0; i<num_entries; i++)
+    {
+        char text[32];
+        long target;
+        entry_t *e = &entries[i];
+        int len = disasm(e->pc, e->op, text, &target);
+        if ((target < 0) || (target > e->pc) || (e->pc - target > 0x400)) continue;
+        loop_t *l = &loops[num_loops++];
+        l->start = target;
+        l->end = e->pc + len;
+        l->iterations = e->count;
+        for (unsigned a=l->start; a<l->end; a++)
+        {
+            if (index_of[a] >= 0) l->cycles += entries[index_of[a]].cycles;
+        }
+    }
+    qsort(loops, num_loops, sizeof(loop_t), loop_by_cycles);
+
+    printf("\nHottest loops:\n");
+    for (int i=0; (i<num_loops) && (i<top/4); i++)
+    {
+        loop_t *l = &loops[i];
+        printf("%04X-%04X  %lu T-states (%.2f%%), back-edge run %lu times\n", l->start, l->end - 1, l->cycles,
+               total_cycles ? (100.0 * l->cycles / total_cycles) : 0.0, l->iterations);
+        for (unsigned a=l->start; a<l->end; a++)
+        {
+            if (index_of[a] >= 0) print_entry(&entries[index_of[a]]);
+        }
+    }
+
+    qsort(entries, num_entries, sizeof(entry_t), by_cycles);
+    printf("\nTop %d PCs by T-states:\n", top);
+    for (int i=0; (i<num_entries) && (i<top); i++) print_entry(&entries[i]);
+
+    free(loops);
+    free(entries);
+    return 0;
+}
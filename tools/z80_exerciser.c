@@ -0,0 +1,496 @@
+// =====================================================================================
+// z80_exerciser - runs the SugarDS Z80 core (arm9/source/cpu/z80/cz80/Z80.c) against a
+// flat 64K map with stub ports, built with whichever core options you want to check
+// (Z80_THREADED, Z80_BLOCK_CACHE, Z80_LAZY_FLAGS). This runs on
+// the PC, not the DS:
+//
+//      make -C tools z80_exerciser Z80OPTS="-DZ80_THREADED"
+//      z80_exerciser loops [seconds]       the synthetic loops - checked and timed
+//      z80_exerciser <loop> [seconds]      just the one loop (e.g. dispatch or mixed)
+//      z80_exerciser zexdoc.com [seconds]  a CP/M instruction exerciser (ZEXDOC/ZEXALL)
+//      z80_exerciser trace [programs]      every register after every instruction (make flags-diff)
+//
+// The synthetic loops each run for the given emulated seconds (at the CPC's 4MHz) and
+// then have their results checked against the same work done in C. The CP/M mode loads
+// the .com file at 0x100 and catches the BDOS calls to print its output - the run fails
+// if any test reports an ERROR or the program doesn't finish. Either way we show how
+// fast the core went in emulated MHz and in millions of instructions a second (M1
+// cycles, from the R register - so a prefixed opcode counts twice). The dispatch loop
+// is all one byte register opcodes so it is mostly the cost of fetching and dispatching
+// them - 'make -C tools dispatch-bench' times it built with a switch() and threaded.
+// The mixed loop (a block copy then an ALU loop through (HL) and (IX+d)) is the one we
+// time per emulated scanline. The exit status is zero on a pass.
+//
+// The trace runs random programs (random memory and registers) and prints all of the
+// registers after every instruction, then again after each of a run of random length
+// slices (so that anything the core carries from one instruction to the next inside a
+// slice - lazy flags above all - gets a chance to go wrong) and a hash of memory at the
+// end. Two builds of the core must print the very same trace - 'make -C tools
+// flags-diff' checks Z80_LAZY_FLAGS against the flags worked out eagerly this way.
+//
+// The core is run a scanline (256 T-states) at a time and a frame (312 lines) at a time
+// the CPU time is rebased - just as amstrad_run() does on the DS - so any idle skipping
+// and block running is exercised the way the emulator uses it.
+// =====================================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#include "Z80.h"
+
+#define CPC_MHZ         4.0
+#define LINE_TSTATES    256
+#define FRAME_LINES     312
+#define FRAME_TSTATES   (LINE_TSTATES * FRAME_LINES)
+
+// -------------------------------------------------------------------------------------
+// What the core expects the emulator to provide - a flat 64K map and nothing mapped in
+// -------------------------------------------------------------------------------------
+Z80 CPU;
+u32 debug[0x10];
+u32 DX, DY;
+u32 R52;
+u8  DAN_Zone0, DAN_Zone1, DAN_Follow, DAN_WaitRET;
+u16 DAN_Config = 0x20, DAN_WaitCFG;     // 0x20 - no Dandanator mapped in
+u8  hack_int_acknoledge = 0;
+
+static u8 mem[0x10000];
+u8  *MemoryMapR[4] = {mem, mem, mem, mem};
+u8  *MemoryMapW[4] = {mem, mem, mem, mem};
+static u32 stamps[32];
+u32 *ScreenDirtyW[4] = {NULL, NULL, NULL, stamps};      // As on a CPC with the screen at C000
+u32 ScreenLine = 1;
+
+static u32 bad_ops = 0;
+static u8  bad_ops_quiet = 0;   // Random programs are full of them
+static u8  cpm_mode = 0;
+static u8  cpm_done = 0;
+static u32 cpm_errors = 0;
+static char cpm_line[256];
+static u32 cpm_len = 0;
+
+void ConfigureMemory(void) {}
+
+void Trap_Bad_Ops(char *prefix, byte I, word W)
+{
+    if ((bad_ops++ < 10) && !bad_ops_quiet) fprintf(stderr, "Bad opcode %s %02X at %04X\n", prefix, I, W);
+}
+
+unsigned char cpu_readport_ams(register unsigned short Port)
+{
+    return 0xFF;
+}
+
+// -------------------------------------------------------------------------------------
+// CP/M - the BDOS entry is an OUT (0),A and the warm boot at 0x0000 an OUT (1),A. We
+// only need console output (2) and print string (9) for the exercisers.
+// -------------------------------------------------------------------------------------
+static void cpm_putc(char c)
+{
+    putchar(c);
+    if ((c == '\n') || (cpm_len == sizeof(cpm_line)-1))
+    {
+        cpm_line[cpm_len] = 0;
+        if (strstr(cpm_line, "ERROR")) cpm_errors++;
+        cpm_len = 0;
+    }
+    else if (c != '\r') cpm_line[cpm_len++] = c;
+}
+
+void cpu_writeport_ams(register unsigned short Port, register unsigned char Value)
+{
+    if (!cpm_mode) return;
+
+    if ((Port & 0xFF) == 1) cpm_done = 1;
+    else if ((Port & 0xFF) == 0)
+    {
+        if (CPU.BC.B.l == 2) cpm_putc(CPU.DE.B.l);
+        else if (CPU.BC.B.l == 9)
+        {
+            for (u16 a = CPU.DE.W; mem[a] != '$'; a++) cpm_putc(mem[a]);
+        }
+        fflush(stdout);
+    }
+}
+
+// -------------------------------------------------------------------------------------
+// Run the core for up to 'tstates' (or until the CP/M program is done) a line at a time
+// rebasing the CPU time each frame. Returns the T-states run and the seconds it took.
+// -------------------------------------------------------------------------------------
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u64 instructions = 0;  // M1 cycles in the last run()
+
+static u64 run(u64 tstates, double *seconds)
+{
+    u64 done = 0;
+    u32 r = CPU.R;
+    double start = now();
+
+    while ((done < tstates) && !cpm_done)
+    {
+        for (u32 line = 1; line <= FRAME_LINES; line++)
+        {
+            ExecZ80(line * LINE_TSTATES);
+        }
+        CPU.TStates -= FRAME_TSTATES;
+        done += FRAME_TSTATES;
+    }
+
+    *seconds = now() - start;
+    instructions = CPU.R - r;
+    return done;
+}
+
+static void reset(void)
+{
+    memset(stamps, 0x00, sizeof(stamps));
+    bad_ops = 0;
+    ResetZ80(&CPU);
+    CPU.IRequest = INT_NONE;
+}
+
+static void show_speed(const char *name, u64 tstates, u64 ops, double seconds)
+{
+    double mhz = tstates / seconds / 1e6;
+    printf("%-10s %8.1f emulated MHz  (%6.1fx a real CPC) %8.1f M instructions/s %7.1f ns/scanline\n",
+           name, mhz, mhz / CPC_MHZ, ops / seconds / 1e6, seconds * 1e9 / (tstates / LINE_TSTATES));
+}
+
+// -------------------------------------------------------------------------------------
+// The synthetic loops. Each one runs at 0x100 forever and leaves behind something we
+// can work out in C - the check passes once the loop has been round at least once.
+// -------------------------------------------------------------------------------------
+typedef struct
+{
+    const char *name;
+    const u8   *code;
+    u16         len;
+    u8        (*check)(void);
+} loop_t;
+
+static const u8 copy_code[] =
+{
+    0x21, 0x00, 0x80,           // 0100  LD   HL,8000h
+    0x11, 0x00, 0x90,           // 0103  LD   DE,9000h
+    0x01, 0x00, 0x04,           // 0106  LD   BC,0400h
+    0xED, 0xB0,                 // 0109  LDIR
+    0x18, 0xF3,                 // 010B  JR   0100h
+};
+
+static u8 copy_check(void)
+{
+    return memcmp(mem + 0x9000, mem + 0x8000, 0x400) == 0;
+}
+
+static const u8 sum_code[] =
+{
+    0x21, 0x00, 0x80,           // 0100  LD   HL,8000h
+    0x11, 0x00, 0x00,           // 0103  LD   DE,0
+    0x06, 0x00,                 // 0106  LD   B,0         ; 256 bytes
+    0x7E,                       // 0108  LD   A,(HL)
+    0x83,                       // 0109  ADD  A,E
+    0x5F,                       // 010A  LD   E,A
+    0x30, 0x01,                 // 010B  JR   NC,010Eh
+    0x14,                       // 010D  INC  D
+    0x23,                       // 010E  INC  HL
+    0x10, 0xF7,                 // 010F  DJNZ 0108h
+    0xED, 0x53, 0x00, 0xA0,     // 0111  LD   (A000h),DE
+    0x18, 0xE9,                 // 0115  JR   0100h
+};
+
+static u8 sum_check(void)
+{
+    u16 sum = 0;
+    for (u32 i = 0; i < 0x100; i++) sum += mem[0x8000 + i];
+    return (mem[0xA000] | (mem[0xA001] << 8)) == sum;
+}
+
+static const u8 index_code[] =
+{
+    0xDD, 0x21, 0x00, 0xA1,     // 0100  LD   IX,A100h
+    0x0E, 0x00,                 // 0104  LD   C,0
+    0x79,                       // 0106  LD   A,C
+    0xCB, 0x07,                 // 0107  RLC  A
+    0xDD, 0x77, 0x00,           // 0109  LD   (IX+0),A
+    0xDD, 0x23,                 // 010C  INC  IX
+    0x0C,                       // 010E  INC  C
+    0x20, 0xF5,                 // 010F  JR   NZ,0106h
+    0x18, 0xED,                 // 0111  JR   0100h
+};
+
+static u8 index_check(void)
+{
+    for (u32 i = 0; i < 0x100; i++)
+    {
+        if (mem[0xA100 + i] != (u8)((i << 1) | (i >> 7))) return 0;
+    }
+    return 1;
+}
+
+static const u8 call_code[] =
+{
+    0x31, 0x00, 0xF0,           // 0100  LD   SP,F000h
+    0x21, 0x00, 0x00,           // 0103  LD   HL,0
+    0x06, 0x64,                 // 0106  LD   B,100
+    0xCD, 0x12, 0x01,           // 0108  CALL 0112h
+    0x10, 0xFB,                 // 010B  DJNZ 0108h
+    0x22, 0x02, 0xA0,           // 010D  LD   (A002h),HL
+    0x18, 0xEE,                 // 0110  JR   0100h
+    0xC5,                       // 0112  PUSH BC
+    0x48,                       // 0113  LD   C,B
+    0x06, 0x00,                 // 0114  LD   B,0
+    0x09,                       // 0116  ADD  HL,BC
+    0xC1,                       // 0117  POP  BC
+    0xC9,                       // 0118  RET
+};
+
+static u8 call_check(void)
+{
+    return (mem[0xA002] | (mem[0xA003] << 8)) == 5050;     // 1 + 2 + ... + 100
+}
+
+static const u8 dispatch_code[] =
+{
+    0x21, 0x00, 0x00,           // 0100  LD   HL,0
+    0x06, 0x00,                 // 0103  LD   B,0         ; 256 passes
+    0x78,                       // 0105  LD   A,B
+    0x87,                       // 0106  ADD  A,A
+    0x4F,                       // 0107  LD   C,A
+    0x0C,                       // 0108  INC  C
+    0x0D,                       // 0109  DEC  C
+    0xA9,                       // 010A  XOR  C
+    0xB7,                       // 010B  OR   A
+    0x79,                       // 010C  LD   A,C
+    0x85,                       // 010D  ADD  A,L
+    0x6F,                       // 010E  LD   L,A
+    0x7C,                       // 010F  LD   A,H
+    0xCE, 0x00,                 // 0110  ADC  A,0
+    0x67,                       // 0112  LD   H,A
+    0x10, 0xF0,                 // 0113  DJNZ 0105h
+    0x22, 0x04, 0xA0,           // 0115  LD   (A004h),HL
+    0x18, 0xE6,                 // 0118  JR   0100h
+};
+
+static u8 dispatch_check(void)
+{
+    u16 sum = 0;
+    for (u32 b = 0; b < 0x100; b++) sum += (u8)(b * 2);
+    return (mem[0xA004] | (mem[0xA005] << 8)) == sum;
+}
+
+static const u8 mixed_code[] =
+{
+    0x21, 0x00, 0x80,           // 0100  LD   HL,8000h
+    0x11, 0x00, 0x90,           // 0103  LD   DE,9000h
+    0x01, 0x00, 0x01,           // 0106  LD   BC,0100h
+    0xED, 0xB0,                 // 0109  LDIR
+    0xDD, 0x21, 0x00, 0xA2,     // 010B  LD   IX,A200h
+    0x21, 0x00, 0x80,           // 010F  LD   HL,8000h
+    0x06, 0x00,                 // 0112  LD   B,0         ; 256 bytes
+    0x7E,                       // 0114  LD   A,(HL)
+    0x23,                       // 0115  INC  HL
+    0x86,                       // 0116  ADD  A,(HL)
+    0xCB, 0x27,                 // 0117  SLA  A
+    0xDD, 0x77, 0x00,           // 0119  LD   (IX+0),A
+    0xDD, 0x23,                 // 011C  INC  IX
+    0x10, 0xF4,                 // 011E  DJNZ 0114h
+    0x18, 0xDE,                 // 0120  JR   0100h
+};
+
+static u8 mixed_check(void)
+{
+    if (memcmp(mem + 0x9000, mem + 0x8000, 0x100)) return 0;
+    for (u32 i = 0; i < 0x100; i++)
+    {
+        if (mem[0xA200 + i] != (u8)((mem[0x8000 + i] + mem[0x8001 + i]) << 1)) return 0;
+    }
+    return 1;
+}
+
+static const loop_t loops[] =
+{
+    {"dispatch", dispatch_code, sizeof(dispatch_code), dispatch_check},
+    {"copy",     copy_code,     sizeof(copy_code),     copy_check},
+    {"sum",      sum_code,      sizeof(sum_code),      sum_check},
+    {"index",    index_code,    sizeof(index_code),    index_check},
+    {"call",     call_code,     sizeof(call_code),     call_check},
+    {"mixed",    mixed_code,    sizeof(mixed_code),    mixed_check},
+};
+
+#define LOOPS   (sizeof(loops) / sizeof(loops[0]))
+
+static int run_loops(double emulated_seconds, u32 first, u32 count)
+{
+    u64 budget = (u64)(emulated_seconds * CPC_MHZ * 1e6);
+    u64 total = 0, total_ops = 0;
+    double total_seconds = 0;
+    int failed = 0;
+
+    for (u32 l = first; l < first + count; l++)
+    {
+        const loop_t *loop = &loops[l];
+        double seconds;
+
+        memset(mem, 0x00, sizeof(mem));
+        for (u32 i = 0; i < 0x400; i++) mem[0x8000 + i] = (u8)(i * 7 + 3);
+        memcpy(mem + 0x100, loop->code, loop->len);
+        reset();
+        CPU.PC.W = 0x100;
+
+        u64 tstates = run(budget, &seconds);
+        show_speed(loop->name, tstates, instructions, seconds);
+        total += tstates;
+        total_ops += instructions;
+        total_seconds += seconds;
+
+        u8 pass = loop->check() && !bad_ops && ((CPU.PC.W & 0xFFFF) >= 0x100) && ((CPU.PC.W & 0xFFFF) < 0x100 + loop->len);
+        if (!pass)
+        {
+            printf("%-10s FAILED (PC=%04X)\n", loop->name, CPU.PC.W & 0xFFFF);
+            failed++;
+        }
+    }
+
+    if (count > 1) show_speed("all", total, total_ops, total_seconds);
+    printf(failed ? "FAIL\n" : "PASS\n");
+    return failed ? 1 : 0;
+}
+
+static int run_cpm(const char *filename, double emulated_seconds)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return 2;
+    }
+
+    memset(mem, 0x00, sizeof(mem));
+    size_t len = fread(mem + 0x100, 1, 0xFE00 - 0x100, file);
+    fclose(file);
+
+    static const u8 page0[] =
+    {
+        0xD3, 0x01,             // 0000  OUT  (1),A       ; warm boot - the program is done
+        0x76,                   // 0002  HALT
+        0x00, 0x00,
+        0xC3, 0x00, 0xFE,       // 0005  JP   FE00h       ; BDOS - and (0006h) is the top of the TPA
+    };
+    static const u8 bdos[] =
+    {
+        0xD3, 0x00,             // FE00  OUT  (0),A
+        0xC9,                   // FE02  RET
+    };
+    memcpy(mem, page0, sizeof(page0));
+    memcpy(mem + 0xFE00, bdos, sizeof(bdos));
+
+    reset();
+    CPU.PC.W = 0x100;
+    CPU.SP.W = 0xFE00;
+    cpm_mode = 1;
+
+    double seconds;
+    u64 budget = emulated_seconds ? (u64)(emulated_seconds * CPC_MHZ * 1e6) : ~0ULL;
+    u64 tstates = run(budget, &seconds);
+
+    printf("\n%s: %lu bytes, %llu T-states, %u errors%s\n", filename, (unsigned long)len, (unsigned long long)tstates,
+           cpm_errors, cpm_done ? "" : " - did not finish");
+    show_speed("cp/m", tstates, instructions, seconds);
+
+    u8 pass = cpm_done && !cpm_errors && !bad_ops;
+    printf(pass ? "PASS\n" : "FAIL\n");
+    return pass ? 0 : 1;
+}
+
+// -------------------------------------------------------------------------------------
+// The trace - the programs and slice lengths come from a fixed seed so every build of
+// the core sees the same ones.
+// -------------------------------------------------------------------------------------
+static u32 rng;
+
+static u32 rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void trace_regs(u32 program, u32 step)
+{
+    printf("%u.%u PC=%04X AF=%04X BC=%04X DE=%04X HL=%04X IX=%04X IY=%04X SP=%04X "
+           "AF'=%04X BC'=%04X DE'=%04X HL'=%04X I=%02X R=%08X IFF=%02X T=%u\n",
+           program, step, CPU.PC.W & 0xFFFF, CPU.AF.W, CPU.BC.W, CPU.DE.W, CPU.HL.W, CPU.IX.W, CPU.IY.W, CPU.SP.W,
+           CPU.AF1.W, CPU.BC1.W, CPU.DE1.W, CPU.HL1.W, CPU.I, CPU.R, CPU.IFF, CPU.TStates);
+}
+
+static void random_program(u32 program)
+{
+    rng = program * 2654435761u + 1;
+    for (u32 i = 0; i < sizeof(mem); i++) mem[i] = rnd();
+    reset();
+    CPU.PC.W  = rnd();
+    CPU.AF.W  = rnd(); CPU.BC.W  = rnd(); CPU.DE.W  = rnd(); CPU.HL.W  = rnd();
+    CPU.AF1.W = rnd(); CPU.BC1.W = rnd(); CPU.DE1.W = rnd(); CPU.HL1.W = rnd();
+    CPU.IX.W  = rnd(); CPU.IY.W  = rnd(); CPU.SP.W  = rnd();
+    CPU.IFF   = rnd() & (IFF_1 | IFF_IM1 | IFF_IM2 | IFF_2);
+    FlushZ80();
+}
+
+static int run_trace(u32 programs)
+{
+    bad_ops_quiet = 1;
+    for (u32 program = 0; program < programs; program++)
+    {
+        random_program(program);
+        for (u32 step = 0; step < 1000; step++)
+        {
+            ExecZ80(CPU.TStates + 1);       // Exactly one instruction
+            trace_regs(program, step);
+        }
+
+        random_program(program);
+        for (u32 slice = 0; slice < 100; slice++)
+        {
+            ExecZ80(CPU.TStates + 1 + (rnd() & 0x1FF));
+            trace_regs(program, 1000 + slice);
+        }
+
+        u32 hash = 2166136261u;
+        for (u32 i = 0; i < sizeof(mem); i++) hash = (hash ^ mem[i]) * 16777619u;
+        printf("%u mem=%08X bad=%u\n", program, hash, bad_ops);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s loops|<loop>|program.com [seconds] | %s trace [programs]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    double seconds = (argc > 2) ? atof(argv[2]) : 0;
+
+    if (strcmp(argv[1], "loops") == 0) return run_loops(seconds ? seconds : 100, 0, LOOPS);
+    for (u32 l = 0; l < LOOPS; l++)
+    {
+        if (strcmp(argv[1], loops[l].name) == 0) return run_loops(seconds ? seconds : 100, l, 1);
+    }
+    if (strcmp(argv[1], "trace") == 0) return run_trace((argc > 2) ? atoi(argv[2]) : 1000);
+    return run_cpm(argv[1], seconds);
+}